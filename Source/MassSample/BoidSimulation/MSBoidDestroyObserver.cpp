@@ -0,0 +1,47 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MSBoidDestroyObserver.h"
+
+#include "MSBoidFragments.h"
+
+UMSBoidDestroyObserver::UMSBoidDestroyObserver()
+{
+	ObservedType = FMSBoidSlotFragment::StaticStruct();
+	Operation = EMassObservedOperation::Remove;
+	ExecutionFlags = (int32)(EProcessorExecutionFlags::All);
+}
+
+void UMSBoidDestroyObserver::Initialize(UObject& Owner)
+{
+	BoidSubsystem = GetWorld()->GetSubsystem<UMSBoidSubsystem>();
+}
+
+void UMSBoidDestroyObserver::ConfigureQueries()
+{
+	DestroyedBoidsQuery.AddRequirement<FMSBoidSlotFragment>(EMassFragmentAccess::ReadOnly);
+	DestroyedBoidsQuery.AddRequirement<FMSBoidNetId>(EMassFragmentAccess::ReadOnly);
+	DestroyedBoidsQuery.AddRequirement<FMSBoidRenderFragment>(EMassFragmentAccess::ReadOnly);
+}
+
+void UMSBoidDestroyObserver::Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context)
+{
+	DestroyedBoidsQuery.ForEachEntityChunk(EntitySubsystem, Context, [this](FMassExecutionContext& Context)
+	{
+		const int32 NumEntities = Context.GetNumEntities();
+		const auto Slots = Context.GetFragmentView<FMSBoidSlotFragment>();
+		const auto NetIds = Context.GetFragmentView<FMSBoidNetId>();
+		const auto Renders = Context.GetFragmentView<FMSBoidRenderFragment>();
+
+		for (int32 i = 0; i < NumEntities; ++i)
+		{
+			// Read right before releasing: an earlier release may have moved this boid into the freed slot or instance
+			BoidSubsystem->ReleaseBoidSlot(Slots[i].Slot);
+			BoidSubsystem->ReleaseHismInstance(Renders[i].HismId);
+			BoidSubsystem->ReleaseNetId(NetIds[i].Id);
+		}
+	});
+
+	// Spatial indices that carry state between frames have to drop the destroyed boids
+	++BoidSubsystem->BoidPopulationVersion;
+}
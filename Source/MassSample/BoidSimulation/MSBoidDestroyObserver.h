@@ -0,0 +1,30 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MassObserverProcessor.h"
+#include "MSBoidSubsystem.h"
+#include "MSBoidDestroyObserver.generated.h"
+
+/**
+ * Hands a destroyed boid's slot, HISM instance and net id back to the subsystem, so the state buffers and the HISM
+ * only ever hold live boids and the replicator stops sending the boid
+ */
+UCLASS()
+class MASSSAMPLE_API UMSBoidDestroyObserver : public UMassObserverProcessor
+{
+	GENERATED_BODY()
+public:
+	UMSBoidDestroyObserver();
+
+protected:
+	virtual void Initialize(UObject& Owner) override;
+	virtual void ConfigureQueries() override;
+	virtual void Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context) override;
+
+	UPROPERTY()
+	UMSBoidSubsystem* BoidSubsystem;
+
+	FMassEntityQuery DestroyedBoidsQuery;
+};
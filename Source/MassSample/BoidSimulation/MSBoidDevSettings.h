@@ -7,6 +7,17 @@
 #include "MSBoidDevSettings.generated.h"
 
 class AMSBoidNiagaraHelper;
+
+/** Structure answering the boid neighbor queries of the forces stage */
+UENUM(BlueprintType)
+enum class EMSBoidSpatialBackend : uint8
+{
+	Octree,
+	HashGrid,
+	/** Boids sorted by Morton code with a parallel radix sort, rebuilt every frame */
+	LinearOctree
+};
+
 /**
  * 
  */
@@ -34,6 +45,75 @@ public:
 	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite, Category = "Boids|Simulation")
 	int32 NumOfBoids = 10;
 
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite, Category = "Boids|Simulation")
+	EMSBoidSpatialBackend SpatialBackend = EMSBoidSpatialBackend::Octree;
+
+	/** Update the boid octree in place, only moving boids that left their node, instead of rebuilding it every frame */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite, Category = "Boids|Simulation")
+	bool bIncrementalOctree = true;
+
+	/** Fraction of boids that have to leave their node in one frame before the incremental update gives up and rebuilds */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite, Category = "Boids|Simulation", meta = (ClampMin = 0, ClampMax = 1))
+	float OctreeRebuildChurnThreshold = 0.25f;
+
+	/** Simulate the boids in fixed steps decoupled from the frame rate, rendering interpolates between the last two */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite, Category = "Boids|Simulation")
+	bool bFixedStepSimulation = false;
+
+	/** Simulation steps per second in fixed step mode */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite, Category = "Boids|Simulation", meta = (ClampMin = 1))
+	float FixedStepHz = 30.0f;
+
+	/** Most steps simulated in one frame, time beyond that is dropped so a hitch can't snowball into the next frames */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite, Category = "Boids|Simulation", meta = (ClampMin = 1))
+	int32 MaxStepsPerFrame = 4;
+
+	/**
+	 * Every peer simulates the boids by itself from a shared spawn seed, in fixed steps and without forces LOD, and
+	 * only checksums go over the net until they disagree. Needs all peers on the same build and platform.
+	 */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite, Category = "Boids|Lockstep")
+	bool bLockstepSimulation = false;
+
+	/** Steps between two state checksums in lockstep */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite, Category = "Boids|Lockstep", meta = (ClampMin = 1))
+	int32 LockstepChecksumInterval = 30;
+
+	/**
+	 * Steps between the server scheduling a seed spawn and the step it happens on, on top of the worst client ping.
+	 * A spawn that reaches a client after its step desyncs that client.
+	 */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite, Category = "Boids|Lockstep", meta = (ClampMin = 0))
+	int32 LockstepSpawnLeadSteps = 15;
+
+	/** Seconds the server ignores further desync reports from a client after taking one */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite, Category = "Boids|Lockstep", meta = (ClampMin = 0))
+	float LockstepDesyncReportCooldown = 5.0f;
+
+	/** Recompute the forces of boids far from every player view less often, they integrate their last force in between */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite, Category = "Boids|Forces LOD")
+	bool bForcesLOD = false;
+
+	/** Boids closer than this to a player view update their forces every step */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite, Category = "Boids|Forces LOD", meta = (ClampMin = 0))
+	float ForcesLODMediumDistance = 5000.0f;
+
+	/** Boids past this distance from every player view are in the far bucket */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite, Category = "Boids|Forces LOD", meta = (ClampMin = 0))
+	float ForcesLODFarDistance = 15000.0f;
+
+	/** Steps between force updates of the medium bucket */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite, Category = "Boids|Forces LOD", meta = (ClampMin = 1))
+	int32 ForcesLODMediumPeriod = 2;
+
+	/** Steps between force updates of the far bucket */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite, Category = "Boids|Forces LOD", meta = (ClampMin = 1))
+	int32 ForcesLODFarPeriod = 4;
+
+	/** Boids per parallel task in the forces stage. 0 runs one task per archetype chunk */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite, Category = "Boids|Simulation", meta = (ClampMin = 0))
+	int32 ForcesBatchSize = 0;
+
 	/** How many times we divide the Boid array based on the LocationUpdateFrequency */
 	UPROPERTY(Config, BlueprintReadWrite, EditAnywhere, Category = "Boids|Net", meta = (ClampMin = 0))
 	uint8 BatchesPerUpdate = 10;
@@ -50,6 +130,64 @@ public:
 	UPROPERTY(Config, BlueprintReadWrite, EditAnywhere, Category = "Boids|Net", meta = (ClampMin = 0))
 	float NetUpdateTimeThreshold = 0.03f;
 
+	/**
+	 * Every how many full updates the boids are sent as absolute locations and velocities, which become the new delta
+	 * baselines. Longer saves bandwidth, but a client that lost a keyframe waits longer for the next one.
+	 */
+	UPROPERTY(Config, BlueprintReadWrite, EditAnywhere, Category = "Boids|Net", meta = (ClampMin = 1))
+	uint8 NetKeyframeInterval = 8;
+
+	/** Clients blend server corrections in over NetCorrectionBlendTime instead of snapping to them */
+	UPROPERTY(Config, BlueprintReadWrite, EditAnywhere, Category = "Boids|Net")
+	bool bSmoothNetCorrections = true;
+
+	/** Seconds a client takes to absorb a server correction */
+	UPROPERTY(Config, BlueprintReadWrite, EditAnywhere, Category = "Boids|Net", meta = (ClampMin = 0))
+	float NetCorrectionBlendTime = 0.5f;
+
+	/** Corrections larger than this snap right away, blending them would only show the boid sliding across the map */
+	UPROPERTY(Config, BlueprintReadWrite, EditAnywhere, Category = "Boids|Net", meta = (ClampMin = 0))
+	float NetCorrectionSnapDistance = 1000.0f;
+
+	/** Bytes of boid locations the multicast may send per batch, highest priority first. 0 sends every changed boid */
+	UPROPERTY(Config, BlueprintReadWrite, EditAnywhere, Category = "Boids|Net", meta = (ClampMin = 0))
+	int32 NetMulticastBytesBudgetPerBatch = 0;
+
+	/**
+	 * Priority a changed boid gains per second it waits for its send, in cm of error. Only matters with a multicast
+	 * budget, it keeps boids with small errors from starving behind the ones with large ones
+	 */
+	UPROPERTY(Config, BlueprintReadWrite, EditAnywhere, Category = "Boids|Net", meta = (ClampMin = 0))
+	float NetPriorityTimeWeight = 10.0f;
+
+	/** Boids per spawn RPC. Spawn data is about 50 bytes a boid and clients drop reliable bunches past 64KB */
+	UPROPERTY(Config, BlueprintReadWrite, EditAnywhere, Category = "Boids|Net", meta = (ClampMin = 1, ClampMax = 1024))
+	int32 NetSpawnChunkSize = 512;
+
+	/** Spawn RPCs each client may be sent per frame, large spawns and late joins go out over several frames */
+	UPROPERTY(Config, BlueprintReadWrite, EditAnywhere, Category = "Boids|Net", meta = (ClampMin = 1))
+	int32 NetSpawnChunksPerFrame = 4;
+
+	/** Send every client its own stream of the boids around its view through its player controller, instead of multicasting */
+	UPROPERTY(Config, BlueprintReadWrite, EditAnywhere, Category = "Boids|Net Relevancy")
+	bool bPerConnectionRelevancy = false;
+
+	/** Boids closer than this to a client's view are sent every full update */
+	UPROPERTY(Config, BlueprintReadWrite, EditAnywhere, Category = "Boids|Net Relevancy", meta = (ClampMin = 0))
+	float NetRelevancyNearDistance = 10000.0f;
+
+	/** Boids further than this from a client's view are not sent to it at all */
+	UPROPERTY(Config, BlueprintReadWrite, EditAnywhere, Category = "Boids|Net Relevancy", meta = (ClampMin = 0))
+	float NetRelevancyFarDistance = 30000.0f;
+
+	/** Full updates between two sends of a boid that is neither near nor far */
+	UPROPERTY(Config, BlueprintReadWrite, EditAnywhere, Category = "Boids|Net Relevancy", meta = (ClampMin = 1))
+	int32 NetRelevancyMediumPeriod = 4;
+
+	/** Bytes of boid locations each client may be sent per batch, the closest boids go first */
+	UPROPERTY(Config, BlueprintReadWrite, EditAnywhere, Category = "Boids|Net Relevancy", meta = (ClampMin = 1))
+	int32 NetBytesBudgetPerBatch = 1024;
+
 	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite, Category = "Boids|Debug")
 	bool DrawDebugBoxes = true;
 
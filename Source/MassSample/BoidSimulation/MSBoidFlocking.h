@@ -0,0 +1,175 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+
+/** Contiguous neighbor candidates stored as SoA floats, the unit the vectorized kernel consumes */
+struct FMSBoidNeighborRange
+{
+	const float* PositionsX;
+	const float* PositionsY;
+	const float* PositionsZ;
+	const float* VelocitiesX;
+	const float* VelocitiesY;
+	const float* VelocitiesZ;
+	int32 Num;
+};
+
+/**
+ * Streaming sum/count of the three flocking terms (align, cohesion and separation).
+ * Neighbors are folded in as they are visited so the forces pass never has to store them anywhere.
+ */
+struct FMSBoidNeighborAccumulator
+{
+	FVector VelocitySum = FVector::ZeroVector;
+	FVector LocationSum = FVector::ZeroVector;
+	FVector RepulsionSum = FVector::ZeroVector;
+	int32 Count = 0;
+
+	FORCEINLINE void Add(const FVector& BoidLocation, const FVector& NeighborLocation, const FVector& NeighborVelocity)
+	{
+		VelocitySum += NeighborVelocity;
+		LocationSum += NeighborLocation;
+		RepulsionSum += BoidLocation - NeighborLocation;
+		++Count;
+	}
+
+	/** Folds in pre-summed neighbors, the repulsion of N neighbors is N * BoidLocation - their location sum */
+	FORCEINLINE void AddSums(const FVector& BoidLocation, const FVector& NeighborLocationSum,
+	                         const FVector& NeighborVelocitySum, const int32 NeighborCount)
+	{
+		VelocitySum += NeighborVelocitySum;
+		LocationSum += NeighborLocationSum;
+		RepulsionSum += BoidLocation * NeighborCount - NeighborLocationSum;
+		Count += NeighborCount;
+	}
+
+	/** Adds the boids of the range within the radius, four at a time using the platform vector registers */
+	void AddRange(const FVector& BoidLocation, float RadiusSquared, const FMSBoidNeighborRange& Range);
+
+	/** Reference for AddRange doing the exact same float math one neighbor at a time */
+	void AddRangeScalar(const FVector& BoidLocation, float RadiusSquared, const FMSBoidNeighborRange& Range);
+
+	/** Matches the old GetVectorArrayAverage path: an empty neighborhood averages to zero */
+	FORCEINLINE FVector ComputeForce(const FVector& BoidLocation, const float AlignWeight, const float CohesionWeight,
+	                                 const float SeparationWeight, const float TargetWeight) const
+	{
+		const float InvCount = Count > 0 ? 1.0f / Count : 0.0f;
+
+		const FVector TargetForce = FVector::ZeroVector - BoidLocation;
+		const FVector AlignForce = VelocitySum * InvCount;
+		const FVector CohesionForce = LocationSum * InvCount - BoidLocation;
+		const FVector AverageRepulsion = RepulsionSum * InvCount;
+
+		return (AlignForce * AlignWeight) + (CohesionForce * CohesionWeight) + (AverageRepulsion * SeparationWeight) +
+			(TargetForce * TargetWeight);
+	}
+};
+
+namespace MSBoidFlocking
+{
+	/** Masked sums of one neighbor, kept in float so the vector and scalar paths round the same way */
+	FORCEINLINE void AddNeighborScalar(const FVector3f& Center, const float RadiusSquared, const FMSBoidNeighborRange& Range,
+	                                   const int32 i, float (&LocationSum)[3], float (&VelocitySum)[3], int32& Count)
+	{
+		const float DX = Range.PositionsX[i] - Center.X;
+		const float DY = Range.PositionsY[i] - Center.Y;
+		const float DZ = Range.PositionsZ[i] - Center.Z;
+
+		// Same association as the vector path: DX * DX + (DY * DY + DZ * DZ)
+		if (DX * DX + (DY * DY + DZ * DZ) < RadiusSquared)
+		{
+			LocationSum[0] += Range.PositionsX[i];
+			LocationSum[1] += Range.PositionsY[i];
+			LocationSum[2] += Range.PositionsZ[i];
+			VelocitySum[0] += Range.VelocitiesX[i];
+			VelocitySum[1] += Range.VelocitiesY[i];
+			VelocitySum[2] += Range.VelocitiesZ[i];
+			++Count;
+		}
+	}
+
+	FORCEINLINE float HorizontalSum(const VectorRegister4Float& Vector)
+	{
+		MS_ALIGN(16) float Lanes[4] GCC_ALIGN(16);
+		VectorStoreAligned(Vector, Lanes);
+		return (Lanes[0] + Lanes[1]) + (Lanes[2] + Lanes[3]);
+	}
+}
+
+inline void FMSBoidNeighborAccumulator::AddRange(const FVector& BoidLocation, const float RadiusSquared,
+                                                 const FMSBoidNeighborRange& Range)
+{
+	const FVector3f Center(BoidLocation);
+	const VectorRegister4Float CenterX = VectorSetFloat1(Center.X);
+	const VectorRegister4Float CenterY = VectorSetFloat1(Center.Y);
+	const VectorRegister4Float CenterZ = VectorSetFloat1(Center.Z);
+	const VectorRegister4Float RadiusSquaredVector = VectorSetFloat1(RadiusSquared);
+	const VectorRegister4Float One = VectorOneFloat();
+
+	VectorRegister4Float SumPX = VectorZeroFloat();
+	VectorRegister4Float SumPY = VectorZeroFloat();
+	VectorRegister4Float SumPZ = VectorZeroFloat();
+	VectorRegister4Float SumVX = VectorZeroFloat();
+	VectorRegister4Float SumVY = VectorZeroFloat();
+	VectorRegister4Float SumVZ = VectorZeroFloat();
+	VectorRegister4Float SumCount = VectorZeroFloat();
+
+	int32 i = 0;
+	for (; i + 4 <= Range.Num; i += 4)
+	{
+		const VectorRegister4Float PX = VectorLoad(Range.PositionsX + i);
+		const VectorRegister4Float PY = VectorLoad(Range.PositionsY + i);
+		const VectorRegister4Float PZ = VectorLoad(Range.PositionsZ + i);
+
+		const VectorRegister4Float DX = VectorSubtract(PX, CenterX);
+		const VectorRegister4Float DY = VectorSubtract(PY, CenterY);
+		const VectorRegister4Float DZ = VectorSubtract(PZ, CenterZ);
+		const VectorRegister4Float DistSquared = VectorMultiplyAdd(DX, DX,
+			VectorMultiplyAdd(DY, DY, VectorMultiply(DZ, DZ)));
+
+		// All ones in the lanes within the radius, and-ing with it zeroes the others out of the sums
+		const VectorRegister4Float Mask = VectorCompareLT(DistSquared, RadiusSquaredVector);
+
+		SumPX = VectorAdd(SumPX, VectorBitwiseAnd(PX, Mask));
+		SumPY = VectorAdd(SumPY, VectorBitwiseAnd(PY, Mask));
+		SumPZ = VectorAdd(SumPZ, VectorBitwiseAnd(PZ, Mask));
+		SumVX = VectorAdd(SumVX, VectorBitwiseAnd(VectorLoad(Range.VelocitiesX + i), Mask));
+		SumVY = VectorAdd(SumVY, VectorBitwiseAnd(VectorLoad(Range.VelocitiesY + i), Mask));
+		SumVZ = VectorAdd(SumVZ, VectorBitwiseAnd(VectorLoad(Range.VelocitiesZ + i), Mask));
+		SumCount = VectorAdd(SumCount, VectorBitwiseAnd(One, Mask));
+	}
+
+	float LocationSums[3] = {
+		MSBoidFlocking::HorizontalSum(SumPX), MSBoidFlocking::HorizontalSum(SumPY), MSBoidFlocking::HorizontalSum(SumPZ)
+	};
+	float VelocitySums[3] = {
+		MSBoidFlocking::HorizontalSum(SumVX), MSBoidFlocking::HorizontalSum(SumVY), MSBoidFlocking::HorizontalSum(SumVZ)
+	};
+	int32 RangeCount = FMath::RoundToInt(MSBoidFlocking::HorizontalSum(SumCount));
+
+	// Leftovers that don't fill a register
+	for (; i < Range.Num; ++i)
+	{
+		MSBoidFlocking::AddNeighborScalar(Center, RadiusSquared, Range, i, LocationSums, VelocitySums, RangeCount);
+	}
+
+	AddSums(BoidLocation, FVector(LocationSums[0], LocationSums[1], LocationSums[2]),
+	        FVector(VelocitySums[0], VelocitySums[1], VelocitySums[2]), RangeCount);
+}
+
+inline void FMSBoidNeighborAccumulator::AddRangeScalar(const FVector& BoidLocation, const float RadiusSquared,
+                                                       const FMSBoidNeighborRange& Range)
+{
+	const FVector3f Center(BoidLocation);
+	float LocationSums[3] = {0.0f, 0.0f, 0.0f};
+	float VelocitySums[3] = {0.0f, 0.0f, 0.0f};
+	int32 RangeCount = 0;
+
+	for (int32 i = 0; i < Range.Num; ++i)
+	{
+		MSBoidFlocking::AddNeighborScalar(Center, RadiusSquared, Range, i, LocationSums, VelocitySums, RangeCount);
+	}
+
+	AddSums(BoidLocation, FVector(LocationSums[0], LocationSums[1], LocationSums[2]),
+	        FVector(VelocitySums[0], VelocitySums[1], VelocitySums[2]), RangeCount);
+}
@@ -5,50 +5,50 @@
 #include "MSBoidFragments.generated.h"
 
 USTRUCT()
-struct FMSBoidLocationFragment : public FMassFragment
+struct FMSBoidForcesFragment : public FMassFragment
 {
 	GENERATED_BODY()
-	FVector Location;
+	FVector ForceResult;
 };
 
 USTRUCT()
-struct FMSBoidCachedLocationFragment : public FMassFragment
+struct FMSBoidTargetFragment : public FMassFragment
 {
 	GENERATED_BODY()
-	FVector CachedLocation;
+	FVector Target;
 };
 
 USTRUCT()
-struct FMSBoidVelocityFragment : public FMassFragment
+struct FMSBoidRenderFragment : public FMassFragment
 {
 	GENERATED_BODY()
-	FVector Velocity;
+	/** INDEX_NONE with Niagara, which reads the boids by slot */
+	int32 HismId = INDEX_NONE;
 };
 
 USTRUCT()
-struct FMSBoidForcesFragment : public FMassFragment
+struct FMSBoidNetId : public FMassFragment
 {
 	GENERATED_BODY()
-	FVector ForceResult;
+	uint16 Id;
 };
 
+/** Stable index of the boid in the subsystem's state buffers */
 USTRUCT()
-struct FMSBoidTargetFragment : public FMassFragment
+struct FMSBoidSlotFragment : public FMassFragment
 {
 	GENERATED_BODY()
-	FVector Target;
+	int32 Slot = INDEX_NONE;
 };
 
+/** Client side. What is left of the last server correction, blended into the location over the following frames */
 USTRUCT()
-struct FMSBoidRenderFragment : public FMassFragment
+struct FMSBoidNetCorrectionFragment : public FMassFragment
 {
 	GENERATED_BODY()
-	uint32 HismId;
-};
+	FVector RemainingError = FVector::ZeroVector;
+	float RemainingTime = 0.0f;
 
-USTRUCT()
-struct FMSBoidNetId : public FMassFragment
-{
-	GENERATED_BODY()
-	uint16 Id;
+	/** Server step of the newest update applied, older ones arriving late are dropped */
+	int32 LastServerStep = INDEX_NONE;
 };
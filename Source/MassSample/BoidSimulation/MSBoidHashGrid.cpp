@@ -0,0 +1,57 @@
+﻿#include "MSBoidHashGrid.h"
+
+#include "Async/ParallelFor.h"
+
+namespace MSBoidHashGrid
+{
+	static constexpr int32 BlockSize = 16384;
+}
+
+void FMSBoidHashGrid::Build(const TConstArrayView<FMassEntityHandle> InEntities,
+                            const TConstArrayView<FVector> InLocations, const TConstArrayView<FVector> InVelocities,
+                            const float CellSize)
+{
+	using namespace MSBoidHashGrid;
+
+	check(InEntities.Num() == InLocations.Num() && InLocations.Num() == InVelocities.Num());
+	InvCellSize = 1.0f / CellSize;
+
+	const int32 NumBoids = InLocations.Num();
+
+	// About one boid per bucket keeps collisions between unrelated cells rare
+	const int32 NumBuckets = FMath::RoundUpToPowerOfTwo(FMath::Max(NumBoids, 1));
+	BucketMask = NumBuckets - 1;
+
+	// Never shrink, the number of boids barely changes from one frame to the next
+	InBuckets.SetNumUninitialized(NumBoids, false);
+	ParallelFor(FMath::DivideAndRoundUp(NumBoids, BlockSize), [this, NumBoids, &InLocations](const int32 BlockIndex)
+	{
+		const int32 Begin = BlockIndex * BlockSize;
+		const int32 End = FMath::Min(Begin + BlockSize, NumBoids);
+
+		for (int32 i = Begin; i < End; ++i)
+		{
+			const FIntVector Cell = GetCell(InLocations[i]);
+			InBuckets[i] = HashCell(Cell.X, Cell.Y, Cell.Z);
+		}
+	});
+
+	// Counting sort: counts become bucket ends with an inclusive prefix sum, then scattering backwards with the
+	// ends as cursors leaves every one of them on its bucket's start
+	BucketStarts.Reset();
+	BucketStarts.AddZeroed(NumBuckets + 1);
+	for (const uint32 Bucket : InBuckets)
+	{
+		++BucketStarts[Bucket];
+	}
+	for (int32 Bucket = 1; Bucket <= NumBuckets; ++Bucket)
+	{
+		BucketStarts[Bucket] += BucketStarts[Bucket - 1];
+	}
+
+	Entries.SetNumUninitialized(NumBoids, false);
+	for (int32 i = NumBoids - 1; i >= 0; --i)
+	{
+		Entries[--BucketStarts[InBuckets[i]]] = {InEntities[i], InLocations[i], InVelocities[i]};
+	}
+}
@@ -0,0 +1,106 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "MassEntityTypes.h"
+#include "Algo/Sort.h"
+
+/** A boid as the hash grid stores it, everything a neighbor query needs sits next to the handle */
+struct FMSBoidHashGridEntry
+{
+	FMassEntityHandle Entity;
+	FVector Location;
+	FVector Velocity;
+};
+
+/**
+ * Spatial hash of the boids, rebuilt from scratch every frame with a counting sort so the entries of a bucket are
+ * contiguous. Queries read the entries inline and never go back to the entity subsystem.
+ */
+class MASSSAMPLE_API FMSBoidHashGrid
+{
+public:
+	/** CellSize should be the sight radius so a query only overlaps the neighbouring cells */
+	void Build(TConstArrayView<FMassEntityHandle> InEntities, TConstArrayView<FVector> InLocations,
+	           TConstArrayView<FVector> InVelocities, float CellSize);
+
+	int32 Num() const { return Entries.Num(); }
+
+	/** Visits every boid inside the sphere. Func is called as Func(const FMSBoidHashGridEntry& Entry) */
+	template<typename FunctionType>
+	void ForEachEntryInRadius(const FVector& Center, const float Radius, const FunctionType& Func) const
+	{
+		if (Entries.Num() == 0) return;
+
+		const float RadiusSquared = Radius * Radius;
+		const FIntVector MinCell = GetCell(Center - FVector(Radius));
+		const FIntVector MaxCell = GetCell(Center + FVector(Radius));
+
+		// Different cells can hash to the same bucket, each bucket must only be scanned once. Sorting and skipping
+		// repeats keeps that O(n log n) for any radius, and a radius up to the cell size never leaves the inline storage
+		TArray<uint32, TInlineAllocator<27>> Buckets;
+		Buckets.Reserve((MaxCell.X - MinCell.X + 1) * (MaxCell.Y - MinCell.Y + 1) * (MaxCell.Z - MinCell.Z + 1));
+
+		for (int32 Z = MinCell.Z; Z <= MaxCell.Z; ++Z)
+		{
+			for (int32 Y = MinCell.Y; Y <= MaxCell.Y; ++Y)
+			{
+				for (int32 X = MinCell.X; X <= MaxCell.X; ++X)
+				{
+					Buckets.Add(HashCell(X, Y, Z));
+				}
+			}
+		}
+
+		Algo::Sort(Buckets);
+
+		for (int32 BucketIndex = 0; BucketIndex < Buckets.Num(); ++BucketIndex)
+		{
+			const uint32 Bucket = Buckets[BucketIndex];
+			if (BucketIndex > 0 && Bucket == Buckets[BucketIndex - 1]) continue;
+
+			for (int32 i = BucketStarts[Bucket]; i < BucketStarts[Bucket + 1]; ++i)
+			{
+				const FMSBoidHashGridEntry& Entry = Entries[i];
+				if (FVector::DistSquared(Center, Entry.Location) < RadiusSquared)
+				{
+					Func(Entry);
+				}
+			}
+		}
+	}
+
+	/** Same as ForEachEntryInRadius, with Func called as Func(const FVector& Location, const FVector& Velocity) */
+	template<typename FunctionType>
+	void ForEachBoidInRadius(const FVector& Center, const float Radius, const FunctionType& Func) const
+	{
+		ForEachEntryInRadius(Center, Radius, [&Func](const FMSBoidHashGridEntry& Entry)
+		{
+			Func(Entry.Location, Entry.Velocity);
+		});
+	}
+
+private:
+	FORCEINLINE FIntVector GetCell(const FVector& Location) const
+	{
+		return FIntVector(
+			FMath::FloorToInt((float)(Location.X * InvCellSize)),
+			FMath::FloorToInt((float)(Location.Y * InvCellSize)),
+			FMath::FloorToInt((float)(Location.Z * InvCellSize))
+		);
+	}
+
+	FORCEINLINE uint32 HashCell(const int32 X, const int32 Y, const int32 Z) const
+	{
+		return ((uint32)X * 73856093u ^ (uint32)Y * 19349663u ^ (uint32)Z * 83492791u) & BucketMask;
+	}
+
+	float InvCellSize = 0.01f;
+	uint32 BucketMask = 0;
+
+	/** Bucket of every input boid */
+	TArray<uint32> InBuckets;
+
+	/** Entries grouped by bucket, bucket i spans [BucketStarts[i], BucketStarts[i + 1]) */
+	TArray<FMSBoidHashGridEntry> Entries;
+	TArray<int32> BucketStarts;
+};
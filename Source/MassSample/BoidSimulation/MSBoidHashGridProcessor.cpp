@@ -6,10 +6,12 @@
 #include "MSBoidFragments.h"
 #include "MSBoidMovementProcessor.h"
 
+DECLARE_CYCLE_STAT(TEXT("Boids Move ~ Hash grid build"), STAT_HashGridBuild, STATGROUP_BoidsMove);
+
 UMSBoidHashGridProcessor::UMSBoidHashGridProcessor()
 {
 	ExecutionOrder.ExecuteBefore.Add(UE::Mass::ProcessorGroupNames::Movement);
-	ExecutionFlags = (int32)EProcessorExecutionFlags::None;
+	ExecutionFlags = (int32)EProcessorExecutionFlags::All;
 }
 
 void UMSBoidHashGridProcessor::Initialize(UObject& Owner)
@@ -19,27 +21,15 @@ void UMSBoidHashGridProcessor::Initialize(UObject& Owner)
 
 void UMSBoidHashGridProcessor::ConfigureQueries()
 {
-	UpdateHashGrid.AddRequirement<FMSBoidCachedLocationFragment>(EMassFragmentAccess::ReadWrite);
-	UpdateHashGrid.AddRequirement<FMSBoidLocationFragment>(EMassFragmentAccess::ReadOnly);
+	// No entity queries, the input comes from the subsystem's state buffer
 }
 
 void UMSBoidHashGridProcessor::Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context)
 {
-	UpdateHashGrid.ForEachEntityChunk(EntitySubsystem, Context, [this](FMassExecutionContext& Context)
-	{
-		const int32 NumEntities = Context.GetNumEntities();
-		const auto Locations = Context.GetFragmentView<FMSBoidLocationFragment>();
-		const auto CachedLocations = Context.GetMutableFragmentView<FMSBoidCachedLocationFragment>();
-
-		for (int i = 0; i < NumEntities; ++i)
-		{
-			const FVector& Location = Locations[i].Location;
-			const FVector& CachedLocation = CachedLocations[i].CachedLocation;
-
-			BoidSubsystem->HashGrid.UpdatePoint(Context.GetEntity(i), CachedLocation, Location);
-
-			// update the cached location for next processor execution
-			CachedLocations[i].CachedLocation = Location;
-		}
-	});
+	if (BoidSubsystem->SpatialBackend != EMSBoidSpatialBackend::HashGrid) return;
+
+	SCOPE_CYCLE_COUNTER(STAT_HashGridBuild);
+
+	// Rebuilt from scratch, moving every boid in place would cost more than the counting sort
+	BoidSubsystem->RebuildSpatialIndex();
 }
@@ -8,7 +8,7 @@
 
 class UMSBoidSubsystem;
 /**
- * 
+ * Rebuilds the subsystem's boid hash grid every frame when it is the selected spatial backend
  */
 UCLASS()
 class MASSSAMPLE_API UMSBoidHashGridProcessor : public UMassProcessor
@@ -23,6 +23,4 @@ class MASSSAMPLE_API UMSBoidHashGridProcessor : public UMassProcessor
 
 	UPROPERTY()
 	UMSBoidSubsystem* BoidSubsystem;
-
-	FMassEntityQuery UpdateHashGrid;
 };
@@ -0,0 +1,202 @@
+﻿#include "MSBoidLinearOctree.h"
+
+#include "Async/ParallelFor.h"
+
+namespace MSBoidLinearOctree
+{
+	/** Boids per parallel block, large enough that a block's histogram work dwarfs the task overhead */
+	static constexpr int32 BlockSize = 16384;
+
+	static constexpr int32 KeyBits = FMSBoidLinearOctree::CellBitsPerAxis * 3;
+	static constexpr int32 RadixBits = 8;
+	static constexpr int32 RadixSize = 1 << RadixBits;
+	static constexpr uint32 RadixMask = RadixSize - 1;
+}
+
+void FMSBoidLinearOctree::Build(const TConstArrayView<FVector> Locations, const TConstArrayView<FVector> Velocities,
+                                const float InMinCellSize)
+{
+	using namespace MSBoidLinearOctree;
+
+	check(Locations.Num() == Velocities.Num());
+	InLocations = Locations;
+	InVelocities = Velocities;
+	MinCellSize = InMinCellSize;
+
+	const int32 NumBoids = InLocations.Num();
+	const int32 NumBlocks = FMath::DivideAndRoundUp(NumBoids, BlockSize);
+
+	ComputeGrid(NumBlocks);
+	ComputeKeys(NumBlocks);
+	SortKeys(NumBlocks);
+	GatherSorted(NumBlocks);
+	BuildCellTable();
+
+	InLocations = TConstArrayView<FVector>();
+	InVelocities = TConstArrayView<FVector>();
+}
+
+void FMSBoidLinearOctree::ComputeGrid(const int32 NumBlocks)
+{
+	using namespace MSBoidLinearOctree;
+
+	BlockBounds.SetNumUninitialized(NumBlocks, false);
+
+	ParallelFor(NumBlocks, [this](const int32 BlockIndex)
+	{
+		const int32 Begin = BlockIndex * BlockSize;
+		const int32 End = FMath::Min(Begin + BlockSize, InLocations.Num());
+
+		FBox Bounds(ForceInit);
+		for (int32 i = Begin; i < End; ++i)
+		{
+			Bounds += InLocations[i];
+		}
+		BlockBounds[BlockIndex] = Bounds;
+	});
+
+	FBox Bounds(ForceInit);
+	for (const FBox& Block : BlockBounds)
+	{
+		Bounds += Block;
+	}
+
+	// Grow the cells past the sight radius when the flock spreads over more than 1024 of them on an axis
+	const float CellSize = FMath::Max(MinCellSize, (float)Bounds.GetSize().GetMax() / MaxCellCoord);
+	InvCellSize = 1.0f / CellSize;
+	Origin = Bounds.IsValid ? Bounds.Min : FVector::ZeroVector;
+}
+
+void FMSBoidLinearOctree::ComputeKeys(const int32 NumBlocks)
+{
+	using namespace MSBoidLinearOctree;
+
+	const int32 NumBoids = InLocations.Num();
+	SortedKeys.SetNumUninitialized(NumBoids, false);
+	SortedIndices.SetNumUninitialized(NumBoids, false);
+
+	ParallelFor(NumBlocks, [this, NumBoids](const int32 BlockIndex)
+	{
+		const int32 Begin = BlockIndex * BlockSize;
+		const int32 End = FMath::Min(Begin + BlockSize, NumBoids);
+
+		for (int32 i = Begin; i < End; ++i)
+		{
+			const FIntVector Cell = GetCell(InLocations[i]);
+			SortedKeys[i] = EncodeMorton(Cell.X, Cell.Y, Cell.Z);
+			SortedIndices[i] = i;
+		}
+	});
+}
+
+void FMSBoidLinearOctree::SortKeys(const int32 NumBlocks)
+{
+	using namespace MSBoidLinearOctree;
+
+	// Never shrink any of the arrays, the number of boids barely changes from one frame to the next
+	const int32 NumBoids = SortedKeys.Num();
+	TempKeys.SetNumUninitialized(NumBoids, false);
+	TempIndices.SetNumUninitialized(NumBoids, false);
+	BlockHistograms.SetNumUninitialized(NumBlocks * RadixSize, false);
+
+	// LSD radix sort, every pass is stable so the order of the lower digits survives the higher ones
+	for (int32 Shift = 0; Shift < KeyBits; Shift += RadixBits)
+	{
+		ParallelFor(NumBlocks, [this, NumBoids, Shift](const int32 BlockIndex)
+		{
+			uint32* Histogram = &BlockHistograms[BlockIndex * RadixSize];
+			FMemory::Memzero(Histogram, RadixSize * sizeof(uint32));
+
+			const int32 Begin = BlockIndex * BlockSize;
+			const int32 End = FMath::Min(Begin + BlockSize, NumBoids);
+			for (int32 i = Begin; i < End; ++i)
+			{
+				++Histogram[(SortedKeys[i] >> Shift) & RadixMask];
+			}
+		});
+
+		// Exclusive prefix sum in digit major order, so each block gets its own slice of every digit's output range
+		uint32 Offset = 0;
+		bool bSingleDigit = false;
+		for (int32 Digit = 0; Digit < RadixSize; ++Digit)
+		{
+			const uint32 DigitStart = Offset;
+			for (int32 BlockIndex = 0; BlockIndex < NumBlocks; ++BlockIndex)
+			{
+				uint32& Count = BlockHistograms[BlockIndex * RadixSize + Digit];
+				const uint32 BlockCount = Count;
+				Count = Offset;
+				Offset += BlockCount;
+			}
+			bSingleDigit |= Offset - DigitStart == (uint32)NumBoids;
+		}
+
+		// Every key shares this digit (common for the top bits of a small flock), the pass wouldn't move anything
+		if (bSingleDigit) continue;
+
+		ParallelFor(NumBlocks, [this, NumBoids, Shift](const int32 BlockIndex)
+		{
+			uint32* Offsets = &BlockHistograms[BlockIndex * RadixSize];
+
+			const int32 Begin = BlockIndex * BlockSize;
+			const int32 End = FMath::Min(Begin + BlockSize, NumBoids);
+			for (int32 i = Begin; i < End; ++i)
+			{
+				const uint32 Destination = Offsets[(SortedKeys[i] >> Shift) & RadixMask]++;
+				TempKeys[Destination] = SortedKeys[i];
+				TempIndices[Destination] = SortedIndices[i];
+			}
+		});
+
+		Swap(SortedKeys, TempKeys);
+		Swap(SortedIndices, TempIndices);
+	}
+}
+
+void FMSBoidLinearOctree::GatherSorted(const int32 NumBlocks)
+{
+	using namespace MSBoidLinearOctree;
+
+	const int32 NumBoids = SortedIndices.Num();
+	PositionsX.SetNumUninitialized(NumBoids, false);
+	PositionsY.SetNumUninitialized(NumBoids, false);
+	PositionsZ.SetNumUninitialized(NumBoids, false);
+	VelocitiesX.SetNumUninitialized(NumBoids, false);
+	VelocitiesY.SetNumUninitialized(NumBoids, false);
+	VelocitiesZ.SetNumUninitialized(NumBoids, false);
+
+	ParallelFor(NumBlocks, [this, NumBoids](const int32 BlockIndex)
+	{
+		const int32 Begin = BlockIndex * BlockSize;
+		const int32 End = FMath::Min(Begin + BlockSize, NumBoids);
+
+		for (int32 i = Begin; i < End; ++i)
+		{
+			const FVector& Location = InLocations[SortedIndices[i]];
+			const FVector& Velocity = InVelocities[SortedIndices[i]];
+			PositionsX[i] = Location.X;
+			PositionsY[i] = Location.Y;
+			PositionsZ[i] = Location.Z;
+			VelocitiesX[i] = Velocity.X;
+			VelocitiesY[i] = Velocity.Y;
+			VelocitiesZ[i] = Velocity.Z;
+		}
+	});
+}
+
+void FMSBoidLinearOctree::BuildCellTable()
+{
+	CellKeys.Reset();
+	CellStarts.Reset();
+
+	// Single linear pass over the sorted keys, not worth splitting up
+	for (int32 i = 0; i < SortedKeys.Num(); ++i)
+	{
+		if (i == 0 || SortedKeys[i] != SortedKeys[i - 1])
+		{
+			CellKeys.Add(SortedKeys[i]);
+			CellStarts.Add(i);
+		}
+	}
+	CellStarts.Add(SortedKeys.Num());
+}
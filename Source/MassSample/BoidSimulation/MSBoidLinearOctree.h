@@ -0,0 +1,150 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Algo/BinarySearch.h"
+#include "MSBoidFlocking.h"
+
+/**
+ * Linear octree of the boids: they are sorted by the Morton code of their grid cell and rebuilt from scratch every frame.
+ * Positions and velocities are stored in sort order as flat float arrays, so a neighbor query only scans a few
+ * contiguous ranges instead of chasing octree nodes.
+ */
+class MASSSAMPLE_API FMSBoidLinearOctree
+{
+public:
+	/** 10 bits per axis, 30 bit keys */
+	static constexpr int32 CellBitsPerAxis = 10;
+	static constexpr int32 MaxCellCoord = (1 << CellBitsPerAxis) - 1;
+
+	/**
+	 * Computes the keys, radix sorts them and lays the boids out in sort order, all in parallel blocks.
+	 * MinCellSize should be the query radius so a query never has to look further than the neighbouring cells.
+	 */
+	void Build(TConstArrayView<FVector> Locations, TConstArrayView<FVector> Velocities, float MinCellSize);
+
+	int32 Num() const { return SortedKeys.Num(); }
+
+	/**
+	 * Hands out the contiguous runs of boids from every cell the sphere's bounding box overlaps, without any distance
+	 * test. Func is called as Func(const FMSBoidNeighborRange& Range).
+	 */
+	template<typename FunctionType>
+	void ForEachRangeInRadius(const FVector& Center, const float Radius, const FunctionType& Func) const
+	{
+		if (CellKeys.Num() == 0) return;
+
+		const FIntVector MinCell = GetCell(Center - FVector(Radius));
+		const FIntVector MaxCell = GetCell(Center + FVector(Radius));
+
+		for (int32 Z = MinCell.Z; Z <= MaxCell.Z; ++Z)
+		{
+			for (int32 Y = MinCell.Y; Y <= MaxCell.Y; ++Y)
+			{
+				for (int32 X = MinCell.X; X <= MaxCell.X; ++X)
+				{
+					const int32 CellIndex = FindCell(EncodeMorton(X, Y, Z));
+					if (CellIndex == INDEX_NONE) continue;
+
+					const int32 Start = CellStarts[CellIndex];
+					Func(FMSBoidNeighborRange{
+						&PositionsX[Start], &PositionsY[Start], &PositionsZ[Start],
+						&VelocitiesX[Start], &VelocitiesY[Start], &VelocitiesZ[Start],
+						CellStarts[CellIndex + 1] - Start
+					});
+				}
+			}
+		}
+	}
+
+	/**
+	 * Visits every boid inside the sphere. Func is called as Func(const FVector& Location, const FVector& Velocity).
+	 * Locations are stored as floats, so they come back rounded to float precision.
+	 */
+	template<typename FunctionType>
+	void ForEachBoidInRadius(const FVector& Center, const float Radius, const FunctionType& Func) const
+	{
+		const float RadiusSquared = Radius * Radius;
+
+		ForEachRangeInRadius(Center, Radius, [&](const FMSBoidNeighborRange& Range)
+		{
+			for (int32 i = 0; i < Range.Num; ++i)
+			{
+				const FVector Location(Range.PositionsX[i], Range.PositionsY[i], Range.PositionsZ[i]);
+				if (FVector::DistSquared(Center, Location) < RadiusSquared)
+				{
+					Func(Location, FVector(Range.VelocitiesX[i], Range.VelocitiesY[i], Range.VelocitiesZ[i]));
+				}
+			}
+		});
+	}
+
+	static FORCEINLINE uint32 EncodeMorton(const uint32 X, const uint32 Y, const uint32 Z)
+	{
+		return SpreadBits(X) | (SpreadBits(Y) << 1) | (SpreadBits(Z) << 2);
+	}
+
+private:
+	/** Inserts two zero bits between each of the lower 10 bits */
+	static FORCEINLINE uint32 SpreadBits(uint32 Value)
+	{
+		Value &= MaxCellCoord;
+		Value = (Value | (Value << 16)) & 0x030000FF;
+		Value = (Value | (Value << 8)) & 0x0300F00F;
+		Value = (Value | (Value << 4)) & 0x030C30C3;
+		Value = (Value | (Value << 2)) & 0x09249249;
+		return Value;
+	}
+
+	/** Boids outside the grid get clamped onto its border cells, queries clamp the same way so nothing is missed */
+	FORCEINLINE FIntVector GetCell(const FVector& Location) const
+	{
+		const FVector Local = (Location - Origin) * InvCellSize;
+		return FIntVector(
+			FMath::Clamp(FMath::FloorToInt((float)Local.X), 0, MaxCellCoord),
+			FMath::Clamp(FMath::FloorToInt((float)Local.Y), 0, MaxCellCoord),
+			FMath::Clamp(FMath::FloorToInt((float)Local.Z), 0, MaxCellCoord)
+		);
+	}
+
+	FORCEINLINE int32 FindCell(const uint32 Key) const
+	{
+		const int32 CellIndex = Algo::LowerBound(CellKeys, Key);
+		return CellKeys.IsValidIndex(CellIndex) && CellKeys[CellIndex] == Key ? CellIndex : INDEX_NONE;
+	}
+
+	void ComputeGrid(int32 NumBlocks);
+	void ComputeKeys(int32 NumBlocks);
+	void SortKeys(int32 NumBlocks);
+	void GatherSorted(int32 NumBlocks);
+	void BuildCellTable();
+
+	float MinCellSize = 100.0f;
+	float InvCellSize = 0.01f;
+	FVector Origin = FVector::ZeroVector;
+
+	/** Unsorted input, only valid during Build */
+	TConstArrayView<FVector> InLocations;
+	TConstArrayView<FVector> InVelocities;
+
+	/** Sort keys and the input index they came from, plus the ping-pong buffers of the radix sort */
+	TArray<uint32> SortedKeys;
+	TArray<int32> SortedIndices;
+	TArray<uint32> TempKeys;
+	TArray<int32> TempIndices;
+
+	/** Per block digit counts, turned into per block scatter offsets in place */
+	TArray<uint32> BlockHistograms;
+	TArray<FBox> BlockBounds;
+
+	/** Boids in sort order */
+	TArray<float> PositionsX;
+	TArray<float> PositionsY;
+	TArray<float> PositionsZ;
+	TArray<float> VelocitiesX;
+	TArray<float> VelocitiesY;
+	TArray<float> VelocitiesZ;
+
+	/** Occupied cells in key order, CellStarts has one extra entry so cell i spans [CellStarts[i], CellStarts[i + 1]) */
+	TArray<uint32> CellKeys;
+	TArray<int32> CellStarts;
+};
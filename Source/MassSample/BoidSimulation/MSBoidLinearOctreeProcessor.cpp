@@ -0,0 +1,34 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MSBoidLinearOctreeProcessor.h"
+
+#include "MassCommonTypes.h"
+#include "MSBoidMovementProcessor.h"
+
+DECLARE_CYCLE_STAT(TEXT("Boids Move ~ Linear octree build"), STAT_LinearOctreeBuild, STATGROUP_BoidsMove);
+
+UMSBoidLinearOctreeProcessor::UMSBoidLinearOctreeProcessor()
+{
+	ExecutionOrder.ExecuteBefore.Add(UE::Mass::ProcessorGroupNames::Movement);
+	ExecutionFlags = (int32)EProcessorExecutionFlags::All;
+}
+
+void UMSBoidLinearOctreeProcessor::Initialize(UObject& Owner)
+{
+	BoidSubsystem = GetWorld()->GetSubsystem<UMSBoidSubsystem>();
+}
+
+void UMSBoidLinearOctreeProcessor::ConfigureQueries()
+{
+	// No entity queries, the input comes from the subsystem's state buffer
+}
+
+void UMSBoidLinearOctreeProcessor::Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context)
+{
+	if (BoidSubsystem->SpatialBackend != EMSBoidSpatialBackend::LinearOctree) return;
+
+	SCOPE_CYCLE_COUNTER(STAT_LinearOctreeBuild);
+
+	BoidSubsystem->RebuildSpatialIndex();
+}
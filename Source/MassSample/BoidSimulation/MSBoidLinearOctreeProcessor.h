@@ -0,0 +1,27 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MassProcessor.h"
+#include "MSBoidSubsystem.h"
+#include "MSBoidLinearOctreeProcessor.generated.h"
+
+/**
+ * Rebuilds the subsystem's linear octree every frame when it is the selected spatial backend.
+ * Reads the boid read state buffer directly, which is already contiguous, so no entity chunks are walked.
+ */
+UCLASS()
+class MASSSAMPLE_API UMSBoidLinearOctreeProcessor : public UMassProcessor
+{
+	GENERATED_BODY()
+
+	UMSBoidLinearOctreeProcessor();
+
+	virtual void Initialize(UObject& Owner) override;
+	virtual void ConfigureQueries() override;
+	virtual void Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context) override;
+
+	UPROPERTY()
+	UMSBoidSubsystem* BoidSubsystem;
+};
@@ -0,0 +1,176 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MSBoidLoadTestCommandlet.h"
+
+#include "MSBoidLoadTestRecorder.h"
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+UMSBoidLoadTestCommandlet::UMSBoidLoadTestCommandlet()
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UMSBoidLoadTestCommandlet::Main(const FString& Params)
+{
+	const TCHAR* ParamsString = *Params;
+
+	int32 NumClients = 4;
+	int32 NumBoids = 10000;
+	float Duration = 60.0f;
+	float Warmup = 10.0f;
+	int32 Port = 7787;
+	float ServerReadyTimeout = 300.0f;
+	float ClientReadyTimeout = 120.0f;
+	float StartDelay = 2.0f;
+	FString Map = TEXT("/Game/MassSample/Maps/BoidSim");
+	FString OutPath = FPaths::ProjectSavedDir() / TEXT("BoidLoadTest") / TEXT("Results.csv");
+	FParse::Value(ParamsString, TEXT("Clients="), NumClients);
+	FParse::Value(ParamsString, TEXT("Boids="), NumBoids);
+	FParse::Value(ParamsString, TEXT("Duration="), Duration);
+	FParse::Value(ParamsString, TEXT("Warmup="), Warmup);
+	FParse::Value(ParamsString, TEXT("Port="), Port);
+	FParse::Value(ParamsString, TEXT("ServerReadyTimeout="), ServerReadyTimeout);
+	FParse::Value(ParamsString, TEXT("ClientReadyTimeout="), ClientReadyTimeout);
+	FParse::Value(ParamsString, TEXT("StartDelay="), StartDelay);
+	FParse::Value(ParamsString, TEXT("Map="), Map);
+	FParse::Value(ParamsString, TEXT("Out="), OutPath);
+	const bool bDedicated = FParse::Param(ParamsString, TEXT("Dedicated"));
+
+	const FString RunDir = FPaths::GetPath(OutPath) / TEXT("Processes");
+	IFileManager::Get().DeleteDirectory(*RunDir, false, true);
+	IFileManager::Get().MakeDirectory(*RunDir, true);
+
+	const FString Executable = FPlatformProcess::ExecutablePath();
+	const FString Project = FPaths::IsProjectFilePathSet()
+		                        ? FString::Printf(TEXT("\"%s\" "), *FPaths::ConvertRelativePathToFull(FPaths::GetProjectFilePath()))
+		                        : FString();
+
+	struct FLoadTestProcess
+	{
+		FString Name;
+		FString CsvPath;
+		FString ReadyPath;
+		FProcHandle Handle;
+	};
+	TArray<FLoadTestProcess> Processes;
+
+	// Every process waits for this file and counts its warmup and duration from the time in it
+	const FString StartPath = RunDir / TEXT("start.time");
+
+	const auto Launch = [&](const FString& Name, const FString& Args)
+	{
+		FLoadTestProcess& Process = Processes.AddDefaulted_GetRef();
+		Process.Name = Name;
+		Process.CsvPath = RunDir / Name + TEXT(".csv");
+		Process.ReadyPath = RunDir / Name + TEXT(".ready");
+
+		const FString CommandLine = Project + Args + FString::Printf(
+			TEXT(" -nullrhi -nosound -nosplash -unattended -stdout -BoidLoadTest -BoidLoadTestName=%s"
+				" -BoidLoadTestCsv=\"%s\" -BoidLoadTestReady=\"%s\" -BoidLoadTestStart=\"%s\""
+				" -BoidLoadTestWarmup=%f -BoidLoadTestDuration=%f -BoidLoadTestBoids=%d -abslog=\"%s\""),
+			*Name, *Process.CsvPath, *Process.ReadyPath, *StartPath, Warmup, Duration, NumBoids,
+			*(RunDir / Name + TEXT(".log")));
+
+		UE_LOG(LogTemp, Display, TEXT("UMSBoidLoadTestCommandlet launching %s: %s %s"), *Name, *Executable, *CommandLine);
+		Process.Handle = FPlatformProcess::CreateProc(*Executable, *CommandLine, false, true, true, nullptr, 0, nullptr,
+		                                              nullptr);
+		return Process.Handle.IsValid();
+	};
+
+	const FString ServerArgs = bDedicated
+		                           ? FString::Printf(TEXT("%s -server -port=%d"), *Map, Port)
+		                           : FString::Printf(TEXT("%s?listen -game -port=%d"), *Map, Port);
+	if (!Launch(TEXT("server"), ServerArgs))
+	{
+		UE_LOG(LogTemp, Error, TEXT("UMSBoidLoadTestCommandlet couldn't start the server"));
+		return 1;
+	}
+
+	// Clients connecting before the server listens would fail and sit in the entry map, so they wait for the server
+	// to write its ready file once the map is loaded. Cold starts with shader and asset loading can take a while.
+	const double ReadyDeadline = FPlatformTime::Seconds() + ServerReadyTimeout;
+	while (!IFileManager::Get().FileExists(*Processes[0].ReadyPath))
+	{
+		FLoadTestProcess& Server = Processes[0];
+		if (!FPlatformProcess::IsProcRunning(Server.Handle) || FPlatformTime::Seconds() > ReadyDeadline)
+		{
+			UE_LOG(LogTemp, Error, TEXT("UMSBoidLoadTestCommandlet the server never got ready, see its log in %s"), *RunDir);
+			FPlatformProcess::TerminateProc(Server.Handle, true);
+			FPlatformProcess::CloseProc(Server.Handle);
+			return 1;
+		}
+		FPlatformProcess::Sleep(0.25f);
+	}
+
+	for (int32 i = 0; i < NumClients; ++i)
+	{
+		Launch(FString::Printf(TEXT("client%d"), i), FString::Printf(TEXT("127.0.0.1:%d -game"), Port));
+	}
+
+	// Clients write their ready file once they are in the server's map, the warmup only starts when all of them are
+	// connected so the server spawns into a full house and nobody measures past the others' end
+	const double ClientDeadline = FPlatformTime::Seconds() + ClientReadyTimeout;
+	for (int32 i = 1; i < Processes.Num(); ++i)
+	{
+		const FLoadTestProcess& Client = Processes[i];
+		while (!IFileManager::Get().FileExists(*Client.ReadyPath))
+		{
+			if (!FPlatformProcess::IsProcRunning(Client.Handle) || FPlatformTime::Seconds() > ClientDeadline)
+			{
+				UE_LOG(LogTemp, Warning, TEXT("UMSBoidLoadTestCommandlet %s never connected, starting without it"), *Client.Name);
+				break;
+			}
+			FPlatformProcess::Sleep(0.25f);
+		}
+	}
+
+	// A little ahead, so every process has read the file by the time it starts. Moved into place so nobody reads half of it.
+	const FDateTime StartTime = FDateTime::UtcNow() + FTimespan::FromSeconds(StartDelay);
+	FFileHelper::SaveStringToFile(LexToString(StartTime.GetTicks()), *(StartPath + TEXT(".tmp")));
+	IFileManager::Get().Move(*StartPath, *(StartPath + TEXT(".tmp")));
+	UE_LOG(LogTemp, Display, TEXT("UMSBoidLoadTestCommandlet warmup starts at %s UTC"), *StartTime.ToString());
+
+	// Processes that hang on the way out get killed, whatever they recorded is on disk already
+	const double Deadline = FPlatformTime::Seconds() + StartDelay + Warmup + Duration + 120.0;
+	for (FLoadTestProcess& Process : Processes)
+	{
+		while (Process.Handle.IsValid() && FPlatformProcess::IsProcRunning(Process.Handle))
+		{
+			if (FPlatformTime::Seconds() > Deadline)
+			{
+				UE_LOG(LogTemp, Warning, TEXT("UMSBoidLoadTestCommandlet %s didn't quit in time, killing it"), *Process.Name);
+				FPlatformProcess::TerminateProc(Process.Handle, true);
+				break;
+			}
+			FPlatformProcess::Sleep(0.5f);
+		}
+		FPlatformProcess::CloseProc(Process.Handle);
+	}
+
+	TArray<FString> Results;
+	Results.Add(AMSBoidLoadTestRecorder::CsvHeader);
+	for (const FLoadTestProcess& Process : Processes)
+	{
+		TArray<FString> Rows;
+		if (!FFileHelper::LoadFileToStringArray(Rows, *Process.CsvPath) || Rows.Num() == 0)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("UMSBoidLoadTestCommandlet %s recorded nothing, see its log in %s"),
+			       *Process.Name, *RunDir);
+			continue;
+		}
+
+		// Every file starts with the same header
+		Results.Append(&Rows[1], Rows.Num() - 1);
+	}
+
+	FFileHelper::SaveStringArrayToFile(Results, *OutPath, FFileHelper::EEncodingOptions::ForceUTF8WithoutBOM);
+	UE_LOG(LogTemp, Display, TEXT("UMSBoidLoadTestCommandlet wrote %d rows to %s"), Results.Num() - 1, *OutPath);
+
+	return 0;
+}
@@ -0,0 +1,27 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "MSBoidLoadTestCommandlet.generated.h"
+
+/**
+ * Boid replication load test. Starts a server and N clients as headless processes of this same binary on the local
+ * machine, waits for them and merges their AMSBoidLoadTestRecorder CSVs into one. Clients start once the server has
+ * written its ready file, and once every client is connected all processes get the same start time for their warmup.
+ *
+ * -run=MSBoidLoadTest [-Clients=4] [-Boids=10000] [-Duration=60] [-Warmup=10] [-Dedicated] [-Port=7787]
+ *                     [-Map=/Game/MassSample/Maps/BoidSim] [-Out=<Saved>/BoidLoadTest/Results.csv]
+ *                     [-ServerReadyTimeout=300] [-ClientReadyTimeout=120] [-StartDelay=2]
+ */
+UCLASS()
+class MASSSAMPLE_API UMSBoidLoadTestCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UMSBoidLoadTestCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
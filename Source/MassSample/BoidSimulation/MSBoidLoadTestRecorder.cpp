@@ -0,0 +1,162 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MSBoidLoadTestRecorder.h"
+
+#include "MSBoidSubsystem.h"
+#include "Engine/NetConnection.h"
+#include "Engine/NetDriver.h"
+#include "Misc/FileHelper.h"
+
+const TCHAR* AMSBoidLoadTestRecorder::CsvHeader = TEXT(
+	"Time,Process,Role,Connection,InBytesPerSecond,OutBytesPerSecond,ReplicationMsPerTick,CorrectionErrorCm,Boids");
+
+namespace MSBoidLoadTest
+{
+	/** Wall clock rather than world or process time, every process of a run and a client dropped back to the entry map
+	 * share it */
+	static float GetSecondsSince(const FDateTime& StartTime)
+	{
+		return (float)(FDateTime::UtcNow() - StartTime).GetTotalSeconds();
+	}
+}
+
+// Sets default values
+AMSBoidLoadTestRecorder::AMSBoidLoadTestRecorder()
+{
+	PrimaryActorTick.bCanEverTick = true;
+}
+
+void AMSBoidLoadTestRecorder::BeginPlay()
+{
+	Super::BeginPlay();
+
+	BoidSubsystem = GetWorld()->GetSubsystem<UMSBoidSubsystem>();
+
+	const TCHAR* CommandLine = FCommandLine::Get();
+	FParse::Value(CommandLine, TEXT("BoidLoadTestCsv="), CsvPath);
+	FParse::Value(CommandLine, TEXT("BoidLoadTestName="), ProcessName);
+	FParse::Value(CommandLine, TEXT("BoidLoadTestWarmup="), WarmupSeconds);
+	FParse::Value(CommandLine, TEXT("BoidLoadTestDuration="), DurationSeconds);
+	FParse::Value(CommandLine, TEXT("BoidLoadTestBoids="), NumBoids);
+
+	if (ProcessName.IsEmpty()) ProcessName = GetWorld()->GetNetMode() == ENetMode::NM_Client ? TEXT("client") : TEXT("server");
+	if (CsvPath.IsEmpty()) CsvPath = FPaths::ProjectSavedDir() / TEXT("BoidLoadTest") / ProcessName + TEXT(".csv");
+
+	// A world restarting in the same process keeps adding to the file the first one started
+	if (!IFileManager::Get().FileExists(*CsvPath))
+	{
+		FFileHelper::SaveStringToFile(FString(CsvHeader) + LINE_TERMINATOR, *CsvPath,
+		                              FFileHelper::EEncodingOptions::ForceUTF8WithoutBOM);
+	}
+
+	// The server's map is loaded and listening by now, a client's is the server's map so it is connected. A client still
+	// in its standalone entry map isn't ready yet.
+	FString ReadyPath;
+	if (GetWorld()->GetNetMode() != ENetMode::NM_Standalone && FParse::Value(CommandLine, TEXT("BoidLoadTestReady="), ReadyPath))
+	{
+		FFileHelper::SaveStringToFile(ProcessName, *ReadyPath);
+	}
+
+	// Run by hand without the commandlet, the process's own clock is all there is
+	if (!FParse::Value(CommandLine, TEXT("BoidLoadTestStart="), StartPath)) StartTime = FDateTime::UtcNow();
+	ReadStartTime();
+}
+
+bool AMSBoidLoadTestRecorder::ReadStartTime()
+{
+	if (StartTime != FDateTime::MinValue()) return true;
+
+	FString StartTicks;
+	if (!FFileHelper::LoadFileToString(StartTicks, *StartPath)) return false;
+
+	int64 Ticks = 0;
+	LexFromString(Ticks, *StartTicks);
+	if (Ticks <= 0) return false;
+
+	StartTime = FDateTime(Ticks);
+	UE_LOG(LogTemp, Display, TEXT("AMSBoidLoadTestRecorder %s starts its warmup at %s UTC"), *ProcessName, *StartTime.ToString());
+	return true;
+}
+
+void AMSBoidLoadTestRecorder::Tick(float DeltaSeconds)
+{
+	Super::Tick(DeltaSeconds);
+
+	// Nothing counts until the commandlet has seen every process ready and picked the start time for all of them
+	if (!ReadStartTime()) return;
+	const float Elapsed = MSBoidLoadTest::GetSecondsSince(StartTime);
+
+	// Every client is connected before the start time, so the boids all reach them through the spawn streams
+	if (!bSpawnedBoids && Elapsed >= WarmupSeconds && GetWorld()->GetNetMode() != ENetMode::NM_Client)
+	{
+		if (NumBoids >= 0) BoidSubsystem->NumOfBoids = NumBoids;
+		BoidSubsystem->SpawnRandomBoids();
+		bSpawnedBoids = true;
+	}
+
+	++TicksSinceRow;
+	SecondsSinceRow += DeltaSeconds;
+	if (SecondsSinceRow >= 1.0f)
+	{
+		if (Elapsed >= WarmupSeconds) WriteRows(SecondsSinceRow);
+		SecondsSinceRow = 0.0f;
+		TicksSinceRow = 0;
+	}
+
+	if (Elapsed >= WarmupSeconds + DurationSeconds)
+	{
+		UE_LOG(LogTemp, Display, TEXT("AMSBoidLoadTestRecorder %s done, results in %s"), *ProcessName, *CsvPath);
+		FPlatformMisc::RequestExit(false);
+		SetActorTickEnabled(false);
+	}
+}
+
+void AMSBoidLoadTestRecorder::WriteRows(const float Interval)
+{
+	const UNetDriver* NetDriver = GetWorld()->GetNetDriver();
+	AMSBoidReplicator* Replicator = BoidSubsystem->BoidReplicator;
+	const float Time = MSBoidLoadTest::GetSecondsSince(StartTime);
+	const int32 Boids = BoidSubsystem->GetReadStateBuffer().Locations.Num();
+
+	const auto FormatRow = [&](const TCHAR* Role, const UNetConnection* Connection, const FString& ReplicationMs,
+	                           const FString& CorrectionError)
+	{
+		return FString::Printf(TEXT("%.2f,%s,%s,%s,%d,%d,%s,%s,%d"), Time, *ProcessName, Role,
+		                       *Connection->LowLevelGetRemoteAddress(true), Connection->InBytesPerSecond,
+		                       Connection->OutBytesPerSecond, *ReplicationMs, *CorrectionError, Boids);
+	};
+
+	TArray<FString> Rows;
+	if (GetWorld()->GetNetMode() == ENetMode::NM_Client)
+	{
+		const FString CorrectionError = Replicator->CorrectionErrorCount > 0
+			                                ? FString::Printf(TEXT("%.3f"), Replicator->CorrectionErrorSum / Replicator->CorrectionErrorCount)
+			                                : FString();
+		if (NetDriver && NetDriver->ServerConnection)
+		{
+			Rows.Add(FormatRow(TEXT("client"), NetDriver->ServerConnection, FString(), CorrectionError));
+		}
+	}
+	else
+	{
+		const FString ReplicationMs = FString::Printf(TEXT("%.4f"),
+		                                              Replicator->ReplicationSeconds * 1000.0 / FMath::Max(TicksSinceRow, 1));
+		if (NetDriver)
+		{
+			for (const UNetConnection* Connection : NetDriver->ClientConnections)
+			{
+				Rows.Add(FormatRow(TEXT("server"), Connection, ReplicationMs, FString()));
+			}
+		}
+	}
+
+	Replicator->ReplicationSeconds = 0.0;
+	Replicator->CorrectionErrorSum = 0.0;
+	Replicator->CorrectionErrorCount = 0;
+
+	if (Rows.Num() == 0) return;
+
+	FFileHelper::SaveStringToFile(FString::Join(Rows, LINE_TERMINATOR) + LINE_TERMINATOR, *CsvPath,
+	                              FFileHelper::EEncodingOptions::ForceUTF8WithoutBOM, &IFileManager::Get(), FILEWRITE_Append);
+}
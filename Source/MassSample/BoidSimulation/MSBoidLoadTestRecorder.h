@@ -0,0 +1,51 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "MSBoidLoadTestRecorder.generated.h"
+
+class UMSBoidSubsystem;
+
+/**
+ * Spawned by the boid subsystem in processes started with -BoidLoadTest, usually by UMSBoidLoadTestCommandlet.
+ * Spawns the boids on the server after a warmup, writes a CSV row per second and quits once the duration is over.
+ * Warmup and duration count from a start time the commandlet hands every process, so they all measure the same window.
+ */
+UCLASS()
+class MASSSAMPLE_API AMSBoidLoadTestRecorder : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	// Sets default values for this actor's properties
+	AMSBoidLoadTestRecorder();
+
+	virtual void BeginPlay() override;
+	virtual void Tick(float DeltaSeconds) override;
+
+	static const TCHAR* CsvHeader;
+
+private:
+	/** Server: one row per client connection. Client: one row for its connection to the server */
+	void WriteRows(float Interval);
+
+	/** Picks up the start time once the commandlet has written it, false until then */
+	bool ReadStartTime();
+
+	FString CsvPath;
+	FString ProcessName;
+	FString StartPath;
+	FDateTime StartTime = FDateTime::MinValue();
+	float WarmupSeconds = 5.0f;
+	float DurationSeconds = 60.0f;
+	int32 NumBoids = INDEX_NONE;
+
+	bool bSpawnedBoids = false;
+	float SecondsSinceRow = 0.0f;
+	int32 TicksSinceRow = 0;
+
+	UPROPERTY()
+	UMSBoidSubsystem* BoidSubsystem;
+};
@@ -6,16 +6,55 @@
 #include "MassCommonTypes.h"
 #include "MassRepresentationTypes.h"
 #include "MSBoidDevSettings.h"
+#include "MSBoidFlocking.h"
 #include "MSBoidFragments.h"
-#include "Kismet/KismetMathLibrary.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/LowLevelMemTracker.h"
 
 DECLARE_CYCLE_STAT(TEXT("Boids Move ~ Movement update"), STAT_Move, STATGROUP_BoidsMove);
 
 DECLARE_CYCLE_STAT(TEXT("Boids Move ~ Forces Query"), STAT_MoveForces, STATGROUP_BoidsMove);
-DECLARE_CYCLE_STAT(TEXT("Boids Move ~ Query octree"), STAT_QueryOctree, STATGROUP_BoidsMove);
-DECLARE_CYCLE_STAT(TEXT("Boids Move ~ Process Octree results"), STAT_ProcessOctreeResults, STATGROUP_BoidsMove);
-DECLARE_CYCLE_STAT(TEXT("Boids Move ~ Calculate velocity"), STAT_MoveVelocity, STATGROUP_BoidsMove);
-DECLARE_CYCLE_STAT(TEXT("Boids Move ~ Perform Movement"), STAT_MoveMove, STATGROUP_BoidsMove);
+DECLARE_CYCLE_STAT(TEXT("Boids Move ~ Integrate velocity and location"), STAT_MoveIntegrate, STATGROUP_BoidsMove);
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Boids Move ~ Forces computed"), STAT_ForcesComputed, STATGROUP_BoidsMove);
+// Approximate: process wide, and stays at 0 with allocators that don't count their calls
+DECLARE_DWORD_COUNTER_STAT(TEXT("Boids Move ~ Malloc calls during forces (approx)"), STAT_ForcesAllocations, STATGROUP_BoidsMove);
+
+// Set on every thread running forces work, so -llm shows exactly what the forces stage allocates
+LLM_DEFINE_TAG(BoidsForces);
+
+/** Used by the scaling report when ForcesBatchSize is 0 and there is no batch size to reuse */
+static constexpr int32 DefaultScalingReportBatchSize = 256;
+
+static bool bForcesScalingReportRequested = false;
+
+static FAutoConsoleCommand ForcesScalingReportCommand(
+	TEXT("boids.ForcesScalingReport"),
+	TEXT("Times the boid forces stage with 1 to N parallel tasks on the next frame and logs the scaling curve."),
+	FConsoleCommandDelegate::CreateLambda([]() { bForcesScalingReportRequested = true; })
+);
+
+static int32 GMSBoidVectorizedForces = 1;
+static FAutoConsoleVariableRef CVarBoidVectorizedForces(
+	TEXT("boids.VectorizedForces"),
+	GMSBoidVectorizedForces,
+	TEXT("Use the vectorized neighbor kernel when the linear octree is the spatial backend.")
+);
+
+static int32 GMSBoidValidateVectorizedForces = 0;
+static FAutoConsoleVariableRef CVarBoidValidateVectorizedForces(
+	TEXT("boids.ValidateVectorizedForces"),
+	GMSBoidValidateVectorizedForces,
+	TEXT("Recompute every vectorized boid force with the scalar reference kernel and ensure both match.")
+);
+
+#if STATS
+/** FMalloc only exposes its call counters to derived classes, this is never instantiated */
+struct FMSMallocCallsAccessor : public FMalloc
+{
+	static uint64 GetTotalMallocCalls() { return TotalMallocCalls; }
+};
+#endif
 
 UMSBoidMovementProcessor::UMSBoidMovementProcessor()
 {
@@ -30,14 +69,11 @@ void UMSBoidMovementProcessor::Initialize(UObject& Owner)
 
 void UMSBoidMovementProcessor::ConfigureQueries()
 {
-	CalculateForcesQuery.AddRequirement<FMSBoidLocationFragment>(EMassFragmentAccess::ReadOnly);
+	CalculateForcesQuery.AddRequirement<FMSBoidSlotFragment>(EMassFragmentAccess::ReadOnly);
 	CalculateForcesQuery.AddRequirement<FMSBoidForcesFragment>(EMassFragmentAccess::ReadWrite);
 
-	CalculateVelocityQuery.AddRequirement<FMSBoidForcesFragment>(EMassFragmentAccess::ReadOnly);
-	CalculateVelocityQuery.AddRequirement<FMSBoidVelocityFragment>(EMassFragmentAccess::ReadWrite);
-
-	MoveBoidsQuery.AddRequirement<FMSBoidVelocityFragment>(EMassFragmentAccess::ReadOnly);
-	MoveBoidsQuery.AddRequirement<FMSBoidLocationFragment>(EMassFragmentAccess::ReadWrite);
+	IntegrateBoidsQuery.AddRequirement<FMSBoidForcesFragment>(EMassFragmentAccess::ReadOnly);
+	IntegrateBoidsQuery.AddRequirement<FMSBoidSlotFragment>(EMassFragmentAccess::ReadOnly);
 }
 
 void UMSBoidMovementProcessor::Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context)
@@ -46,165 +82,307 @@ void UMSBoidMovementProcessor::Execute(UMassEntitySubsystem& EntitySubsystem, FM
 
 	SCOPE_CYCLE_COUNTER(STAT_Move);
 
-	CalculateForcesQuery.ForEachEntityChunk(EntitySubsystem, Context, [&, this](FMassExecutionContext& Context)
+	if (bForcesScalingReportRequested)
 	{
-		SCOPE_CYCLE_COUNTER(STAT_MoveForces);
+		bForcesScalingReportRequested = false;
+		ReportForcesScaling(EntitySubsystem, Context);
+	}
 
-		const int32 NumEntities = Context.GetNumEntities();
-		const float SightRadius = BoidSubsystem->BoidSightRadius;
-		const float TargetWeight = BoidSubsystem->TargetWeight;
-		const float AlignWeight = BoidSubsystem->AlignWeight;
-		const float CohesionWeight = BoidSubsystem->CohesionWeight;
-		const float SeparationWeight = BoidSubsystem->SeparationWeight;
+	const int32 NumSteps = BoidSubsystem->AdvanceSimulationClock(Context.GetDeltaTimeSeconds());
+	const float StepTime = BoidSubsystem->GetSimulationStepTime();
 
-		const auto Locations = Context.GetFragmentView<FMSBoidLocationFragment>();
-		const auto Forces = Context.GetMutableFragmentView<FMSBoidForcesFragment>();
+	const bool bLockstep = BoidSubsystem->IsLockstep();
 
-		FCriticalSection Mutex;
-		ParallelFor(NumEntities, [&](int32 i)
+	for (int32 Step = 0; Step < NumSteps; ++Step)
+	{
+		// Seed spawns land between steps outside of processing, the steps left wait for them until next frame
+		if (bLockstep && BoidSubsystem->IsSeedSpawnDue())
 		{
-			TArray<FMSBoid> BoidsInRadius;
+			BoidSubsystem->DeferSimulationSteps(NumSteps - Step);
+			break;
+		}
 
-			{
-				SCOPE_CYCLE_COUNTER(STAT_QueryOctree);
-				const FBoxCenterAndExtent OctreeQuery =
-					FBoxCenterAndExtent(Locations[i].Location, FVector(SightRadius));
-				BoidsInRadius = BoidSubsystem->GetBoidsInRadius(OctreeQuery);
-			}
+		// The index processors only ran ahead of the first step of the frame. In lockstep the neighbor order has to
+		// match between peers too, so the index is rebuilt from the step's exact state every time
+		if (Step > 0 || bLockstep)
+		{
+			BoidSubsystem->RebuildSpatialIndex();
+		}
 
-			{
-				SCOPE_CYCLE_COUNTER(STAT_ProcessOctreeResults);
-				TArray<FVector> BoidVelocities;
-				TArray<FVector> BoidLocations;
-				TArray<FVector> BoidRepulsionForces;
-
-				for (const FMSBoid& Boid : BoidsInRadius)
-				{
-					if (UE::Geometry::DistanceSquared(Locations[i].Location, Boid.Location) < (SightRadius * SightRadius))
-					{
-						BoidVelocities.Push(Boid.Velocity);
-						BoidLocations.Push(Boid.Location);
-						FVector RepulsionDirection = Locations[i].Location - Boid.Location;
-						//RepulsionDirection = RepulsionDirection * (1 / RepulsionDirection.Length());
-
-						BoidRepulsionForces.Push(RepulsionDirection);
-					}
-				}
-
-				// const TArray<FMassEntityHandle> BoidsInRadius = BoidSubsystem->GetBoidsInRadius(Locations[i].Location, SightRadius);
-				// TArray<FVector> BoidVelocities;
-				// TArray<FVector> BoidLocations;
-				// TArray<FVector> BoidRepulsionForces;
-				//
-				// for (const FMassEntityHandle& BoidHandle : BoidsInRadius)
-				// {
-				// 	const FVector& BoidHandleLocation = EntitySubsystem.GetFragmentDataChecked<FMSBoidLocationFragment>(BoidHandle).Location;
-				// 	BoidVelocities.Push(EntitySubsystem.GetFragmentDataChecked<FMSBoidVelocityFragment>(BoidHandle).Velocity);
-				// 	BoidLocations.Push(BoidHandleLocation);
-				// 	FVector RepulsionDirection = Locations[i].Location - BoidHandleLocation;
-				//
-				// 	BoidRepulsionForces.Push(RepulsionDirection);
-				// }
-
-				const auto TargetForce = FVector::ZeroVector - Locations[i].Location;
-				const auto AlignForce = UKismetMathLibrary::GetVectorArrayAverage(BoidVelocities);
-				const auto AverageLocations = UKismetMathLibrary::GetVectorArrayAverage(BoidLocations);
-				const auto AverageRepulsion = UKismetMathLibrary::GetVectorArrayAverage(BoidRepulsionForces);
-
-				const auto CohesionForce = AverageLocations - Locations[i].Location;
-
-				Mutex.Lock();
-				Forces[i].ForceResult = (AlignForce * AlignWeight) + (CohesionForce * CohesionWeight) + (
-					AverageRepulsion *
-					SeparationWeight) + (TargetForce * TargetWeight);
-				Mutex.Unlock();
-			}
+		SimulateStep(EntitySubsystem, Context, StepTime);
+		BoidSubsystem->RecordLockstepChecksum();
+	}
+}
+
+void UMSBoidMovementProcessor::SimulateStep(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context,
+                                            const float StepTime)
+{
+#if STATS
+	// Only a hint: the counter is process wide, so other threads allocating during the forces stage show up too,
+	// and it only moves with allocators calling IncrementTotalMallocCalls. LLM's BoidsForces tag has the real bytes.
+	const uint64 MallocCallsBefore = FMSMallocCallsAccessor::GetTotalMallocCalls();
+#endif
+
+	PrepareForcesLOD();
+
+	const int32 ForcesBatchSize = BoidSubsystem->BoidSettings->ForcesBatchSize;
+
+	if (ForcesBatchSize <= 0)
+	{
+		CalculateForcesQuery.ParallelForEachEntityChunk(EntitySubsystem, Context, [this](FMassExecutionContext& Context)
+		{
+			SCOPE_CYCLE_COUNTER(STAT_MoveForces);
+			LLM_SCOPE_BYTAG(BoidsForces);
+
+			FMSBoidForcesBatch Batch;
+			Batch.Slots = Context.GetFragmentView<FMSBoidSlotFragment>();
+			Batch.Forces = Context.GetMutableFragmentView<FMSBoidForcesFragment>();
+			Batch.End = Context.GetNumEntities();
+			CalculateForcesForRange(Batch);
 		});
+	}
+	else
+	{
+		// Chunks hold thousands of boids, so with few chunks we split them further to keep every worker busy
+		GatherForcesBatches(EntitySubsystem, Context, ForcesBatchSize);
 
-		for (int i = 0; i < NumEntities; ++i)
+		ParallelFor(ForcesBatches.Num(), [this](int32 BatchIndex)
 		{
-			// TArray<FMSBoid> BoidsInRadius;
-			//
-			// {
-			// 	SCOPE_CYCLE_COUNTER(STAT_QueryOctree);
-			// 	const FBoxCenterAndExtent OctreeQuery =
-			// 		FBoxCenterAndExtent(Locations[i].Location, FVector(SightRadius));
-			// 	BoidsInRadius = BoidSubsystem->GetBoidsInRadius(OctreeQuery);
-			// }
-			//
-			// {
-			// 	SCOPE_CYCLE_COUNTER(STAT_ProcessOctreeResults);
-			// 	TArray<FVector> BoidVelocities;
-			// 	TArray<FVector> BoidLocations;
-			// 	TArray<FVector> BoidRepulsionForces;
-			//
-			// 	for (const FMSBoid& Boid : BoidsInRadius)
-			// 	{
-			// 		if (UE::Geometry::DistanceSquared(Locations[i].Location, Boid.Location) < (SightRadius * SightRadius))
-			// 		{
-			// 			BoidVelocities.Push(Boid.Velocity);
-			// 			BoidLocations.Push(Boid.Location);
-			// 			FVector RepulsionDirection = Locations[i].Location - Boid.Location;
-			// 			//RepulsionDirection = RepulsionDirection * (1 / RepulsionDirection.Length());
-			//
-			// 			BoidRepulsionForces.Push(RepulsionDirection);
-			// 		}
-			// 	}
-			//
-			// 	// const TArray<FMassEntityHandle> BoidsInRadius = BoidSubsystem->GetBoidsInRadius(Locations[i].Location, SightRadius);
-			// 	// TArray<FVector> BoidVelocities;
-			// 	// TArray<FVector> BoidLocations;
-			// 	// TArray<FVector> BoidRepulsionForces;
-			// 	//
-			// 	// for (const FMassEntityHandle& BoidHandle : BoidsInRadius)
-			// 	// {
-			// 	// 	const FVector& BoidHandleLocation = EntitySubsystem.GetFragmentDataChecked<FMSBoidLocationFragment>(BoidHandle).Location;
-			// 	// 	BoidVelocities.Push(EntitySubsystem.GetFragmentDataChecked<FMSBoidVelocityFragment>(BoidHandle).Velocity);
-			// 	// 	BoidLocations.Push(BoidHandleLocation);
-			// 	// 	FVector RepulsionDirection = Locations[i].Location - BoidHandleLocation;
-			// 	//
-			// 	// 	BoidRepulsionForces.Push(RepulsionDirection);
-			// 	// }
-			//
-			// 	const auto TargetForce = FVector::ZeroVector - Locations[i].Location;
-			// 	const auto AlignForce = UKismetMathLibrary::GetVectorArrayAverage(BoidVelocities);
-			// 	const auto AverageLocations = UKismetMathLibrary::GetVectorArrayAverage(BoidLocations);
-			// 	const auto AverageRepulsion = UKismetMathLibrary::GetVectorArrayAverage(BoidRepulsionForces);
-			//
-			// 	const auto CohesionForce = AverageLocations - Locations[i].Location;
-			//
-			// 	Forces[i].ForceResult = (AlignForce * AlignWeight) + (CohesionForce * CohesionWeight) + (
-			// 		AverageRepulsion *
-			// 		SeparationWeight) + (TargetForce * TargetWeight);
-			// }
-		}
-	});
+			SCOPE_CYCLE_COUNTER(STAT_MoveForces);
+			LLM_SCOPE_BYTAG(BoidsForces);
+
+			CalculateForcesForRange(ForcesBatches[BatchIndex]);
+		});
+	}
+
+#if STATS
+	INC_DWORD_STAT_BY(STAT_ForcesAllocations, FMSMallocCallsAccessor::GetTotalMallocCalls() - MallocCallsBefore);
+#endif
 
-	CalculateVelocityQuery.ForEachEntityChunk(EntitySubsystem, Context, [this](FMassExecutionContext& Context)
+	const FMSBoidStateBuffer& ReadBuffer = BoidSubsystem->GetReadStateBuffer();
+	FMSBoidStateBuffer& WriteBuffer = BoidSubsystem->GetWriteStateBuffer();
+
+	// The state buffers are the only copy of location and velocity: last step's state in, this step's state out
+	IntegrateBoidsQuery.ParallelForEachEntityChunk(EntitySubsystem, Context,
+		[this, &ReadBuffer, &WriteBuffer, StepTime](FMassExecutionContext& Context)
 	{
-		SCOPE_CYCLE_COUNTER(STAT_MoveVelocity);
+		SCOPE_CYCLE_COUNTER(STAT_MoveIntegrate);
 
 		const int32 NumEntities = Context.GetNumEntities();
-		const auto Velocities = Context.GetMutableFragmentView<FMSBoidVelocityFragment>();
+		const float MaxSpeed = BoidSubsystem->BoidMaxSpeed;
 		const auto Forces = Context.GetFragmentView<FMSBoidForcesFragment>();
+		const auto Slots = Context.GetFragmentView<FMSBoidSlotFragment>();
 
 		for (int i = 0; i < NumEntities; ++i)
 		{
-			Velocities[i].Velocity = UKismetMathLibrary::ClampVectorSize(
-				(Velocities[i].Velocity + Forces[i].ForceResult), 0, BoidSubsystem->BoidMaxSpeed);
+			const int32 Slot = Slots[i].Slot;
+			const FVector Velocity = (ReadBuffer.Velocities[Slot] + Forces[i].ForceResult).GetClampedToMaxSize(MaxSpeed);
+			WriteBuffer.Locations[Slot] = ReadBuffer.Locations[Slot] + Velocity * StepTime;
+			WriteBuffer.Velocities[Slot] = Velocity;
 		}
 	});
 
-	MoveBoidsQuery.ForEachEntityChunk(EntitySubsystem, Context, [this](FMassExecutionContext& Context)
+	// Everything reading boid state from here on (next frame's spatial index, rendering) sees this step
+	BoidSubsystem->SwapStateBuffers();
+}
+
+void UMSBoidMovementProcessor::PrepareForcesLOD()
+{
+	const UMSBoidDevSettings* BoidSettings = BoidSubsystem->BoidSettings;
+
+	ForcesLODViewLocations.Reset();
+	// Peers look from different places, view based LOD would have each of them skip different boids
+	if (BoidSettings->bForcesLOD && !BoidSubsystem->IsLockstep())
+	{
+		for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; ++It)
+		{
+			if (const APlayerController* PlayerController = It->Get())
+			{
+				FVector ViewLocation;
+				FRotator ViewRotation;
+				PlayerController->GetPlayerViewPoint(ViewLocation, ViewRotation);
+				ForcesLODViewLocations.Add(ViewLocation);
+			}
+		}
+	}
+
+	// Without anybody watching there is nothing to measure the distance to, so everything runs at full rate
+	bForcesLODActive = ForcesLODViewLocations.Num() > 0;
+	ForcesLODStep = BoidSubsystem->GetSimulationStep();
+	ForcesLODMediumDistanceSquared = FMath::Square(BoidSettings->ForcesLODMediumDistance);
+	ForcesLODFarDistanceSquared = FMath::Square(BoidSettings->ForcesLODFarDistance);
+}
+
+bool UMSBoidMovementProcessor::ShouldUpdateForces(const FVector& Location, const int32 Slot) const
+{
+	if (!bForcesLODActive) return true;
+
+	float ClosestViewDistanceSquared = MAX_flt;
+	for (const FVector& ViewLocation : ForcesLODViewLocations)
+	{
+		ClosestViewDistanceSquared = FMath::Min(ClosestViewDistanceSquared,
+		                                        (float)FVector::DistSquared(ViewLocation, Location));
+	}
+
+	if (ClosestViewDistanceSquared < ForcesLODMediumDistanceSquared) return true;
+
+	const UMSBoidDevSettings* BoidSettings = BoidSubsystem->BoidSettings;
+	const uint32 Period = ClosestViewDistanceSquared < ForcesLODFarDistanceSquared
+		                      ? BoidSettings->ForcesLODMediumPeriod
+		                      : BoidSettings->ForcesLODFarPeriod;
+
+	return (ForcesLODStep + Slot) % FMath::Max(Period, 1u) == 0;
+}
+
+void UMSBoidMovementProcessor::CalculateForcesForRange(const FMSBoidForcesBatch& Batch) const
+{
+	const float SightRadius = BoidSubsystem->BoidSightRadius;
+	const float TargetWeight = BoidSubsystem->TargetWeight;
+	const float AlignWeight = BoidSubsystem->AlignWeight;
+	const float CohesionWeight = BoidSubsystem->CohesionWeight;
+	const float SeparationWeight = BoidSubsystem->SeparationWeight;
+
+	if (BoidSubsystem->SpatialBackend == EMSBoidSpatialBackend::LinearOctree && GMSBoidVectorizedForces)
+	{
+		CalculateForcesForRangeVectorized(Batch);
+		return;
+	}
+
+	const FMSBoidStateBuffer& ReadBuffer = BoidSubsystem->GetReadStateBuffer();
+	int32 NumComputed = 0;
+
+	for (int32 i = Batch.Begin; i < Batch.End; ++i)
+	{
+		const int32 Slot = Batch.Slots[i].Slot;
+		const FVector& BoidLocation = ReadBuffer.Locations[Slot];
+
+		// Skipped boids keep integrating with the force of their last update
+		if (!ShouldUpdateForces(BoidLocation, Slot)) continue;
+
+		FMSBoidNeighborAccumulator Neighbors;
+
+		BoidSubsystem->ForEachBoidInRadius(BoidLocation, SightRadius,
+			[&Neighbors, &BoidLocation](const FVector& NeighborLocation, const FVector& NeighborVelocity)
+			{
+				Neighbors.Add(BoidLocation, NeighborLocation, NeighborVelocity);
+			});
+
+		Batch.Forces[i].ForceResult = Neighbors.ComputeForce(BoidLocation, AlignWeight, CohesionWeight,
+		                                                     SeparationWeight, TargetWeight);
+		++NumComputed;
+	}
+
+	INC_DWORD_STAT_BY(STAT_ForcesComputed, NumComputed);
+}
+
+void UMSBoidMovementProcessor::CalculateForcesForRangeVectorized(const FMSBoidForcesBatch& Batch) const
+{
+	const FMSBoidLinearOctree& LinearOctree = BoidSubsystem->LinearOctree;
+	const float SightRadius = BoidSubsystem->BoidSightRadius;
+	const float SightRadiusSquared = SightRadius * SightRadius;
+	const float TargetWeight = BoidSubsystem->TargetWeight;
+	const float AlignWeight = BoidSubsystem->AlignWeight;
+	const float CohesionWeight = BoidSubsystem->CohesionWeight;
+	const float SeparationWeight = BoidSubsystem->SeparationWeight;
+	const bool bValidate = GMSBoidValidateVectorizedForces != 0;
+
+	const FMSBoidStateBuffer& ReadBuffer = BoidSubsystem->GetReadStateBuffer();
+	int32 NumComputed = 0;
+
+	for (int32 i = Batch.Begin; i < Batch.End; ++i)
+	{
+		const int32 Slot = Batch.Slots[i].Slot;
+		const FVector& BoidLocation = ReadBuffer.Locations[Slot];
+
+		if (!ShouldUpdateForces(BoidLocation, Slot)) continue;
+
+		FMSBoidNeighborAccumulator Neighbors;
+
+		LinearOctree.ForEachRangeInRadius(BoidLocation, SightRadius, [&](const FMSBoidNeighborRange& Range)
+		{
+			Neighbors.AddRange(BoidLocation, SightRadiusSquared, Range);
+		});
+
+		FVector& Force = Batch.Forces[i].ForceResult;
+		Force = Neighbors.ComputeForce(BoidLocation, AlignWeight, CohesionWeight, SeparationWeight, TargetWeight);
+		++NumComputed;
+
+		if (bValidate)
+		{
+			FMSBoidNeighborAccumulator Reference;
+			LinearOctree.ForEachRangeInRadius(BoidLocation, SightRadius, [&](const FMSBoidNeighborRange& Range)
+			{
+				Reference.AddRangeScalar(BoidLocation, SightRadiusSquared, Range);
+			});
+
+			const FVector ReferenceForce = Reference.ComputeForce(BoidLocation, AlignWeight, CohesionWeight,
+			                                                      SeparationWeight, TargetWeight);
+
+			// The vector path may fuse the distance multiply-adds, so a neighbor right on the sight radius can land on
+			// either side. Forces are only compared when both saw the same neighbors, the sums then only differ in
+			// the order of the float additions
+			const int32 CountTolerance = FMath::Max(1, Reference.Count / 100);
+			const float Tolerance = 1e-3f * FMath::Max(1.0f, (float)ReferenceForce.GetAbsMax());
+			ensureMsgf(FMath::Abs(Reference.Count - Neighbors.Count) <= CountTolerance &&
+			           (Reference.Count != Neighbors.Count || Force.Equals(ReferenceForce, Tolerance)),
+			           TEXT("Vectorized boid force %s (%d neighbors) doesn't match the scalar reference %s (%d neighbors)"),
+			           *Force.ToString(), Neighbors.Count, *ReferenceForce.ToString(), Reference.Count);
+		}
+	}
+
+	INC_DWORD_STAT_BY(STAT_ForcesComputed, NumComputed);
+}
+
+void UMSBoidMovementProcessor::GatherForcesBatches(UMassEntitySubsystem& EntitySubsystem,
+                                                   FMassExecutionContext& Context, const int32 BatchSize)
+{
+	// Keeps its allocation between frames
+	ForcesBatches.Reset();
+
+	CalculateForcesQuery.ForEachEntityChunk(EntitySubsystem, Context, [this, BatchSize](FMassExecutionContext& Context)
 	{
 		const int32 NumEntities = Context.GetNumEntities();
-		const auto Locations = Context.GetMutableFragmentView<FMSBoidLocationFragment>();
-		const auto Velocities = Context.GetFragmentView<FMSBoidVelocityFragment>();
+		const auto Slots = Context.GetFragmentView<FMSBoidSlotFragment>();
+		const auto Forces = Context.GetMutableFragmentView<FMSBoidForcesFragment>();
 
-		for (int i = 0; i < NumEntities; ++i)
+		for (int32 Begin = 0; Begin < NumEntities; Begin += BatchSize)
 		{
-			SCOPE_CYCLE_COUNTER(STAT_MoveMove);
-			Locations[i].Location = Locations[i].Location + Velocities[i].Velocity * Context.GetDeltaTimeSeconds();
+			FMSBoidForcesBatch& Batch = ForcesBatches.AddDefaulted_GetRef();
+			Batch.Slots = Slots;
+			Batch.Forces = Forces;
+			Batch.Begin = Begin;
+			Batch.End = FMath::Min(Begin + BatchSize, NumEntities);
 		}
 	});
 }
+
+void UMSBoidMovementProcessor::ReportForcesScaling(UMassEntitySubsystem& EntitySubsystem,
+                                                   FMassExecutionContext& Context)
+{
+	const int32 ForcesBatchSize = BoidSubsystem->BoidSettings->ForcesBatchSize;
+	GatherForcesBatches(EntitySubsystem, Context, ForcesBatchSize > 0 ? ForcesBatchSize : DefaultScalingReportBatchSize);
+
+	// The calling thread helps out in ParallelFor, so workers + 1 tasks can run at the same time
+	const int32 MaxTasks = FTaskGraphInterface::Get().GetNumWorkerThreads() + 1;
+	double SingleTaskMs = 0.0;
+
+	for (int32 NumTasks = 1; NumTasks <= MaxTasks; ++NumTasks)
+	{
+		const double StartTime = FPlatformTime::Seconds();
+
+		// Each task strides over the batches, so at most NumTasks threads work at once
+		ParallelFor(NumTasks, [this, NumTasks](int32 TaskIndex)
+		{
+			for (int32 BatchIndex = TaskIndex; BatchIndex < ForcesBatches.Num(); BatchIndex += NumTasks)
+			{
+				CalculateForcesForRange(ForcesBatches[BatchIndex]);
+			}
+		});
+
+		const double ElapsedMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+		if (NumTasks == 1) SingleTaskMs = ElapsedMs;
+
+		UE_LOG(LogTemp, Log, TEXT("Boid forces scaling: %d thread(s), %d batches, %.3f ms, speedup x%.2f"),
+		       NumTasks, ForcesBatches.Num(), ElapsedMs, ElapsedMs > 0.0 ? SingleTaskMs / ElapsedMs : 0.0);
+	}
+}
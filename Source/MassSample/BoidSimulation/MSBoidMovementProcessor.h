@@ -4,11 +4,21 @@
 
 #include "CoreMinimal.h"
 #include "MassProcessor.h"
+#include "MSBoidFragments.h"
 #include "MSBoidSubsystem.h"
 #include "MSBoidMovementProcessor.generated.h"
 
 DECLARE_STATS_GROUP(TEXT("BoidsMove"), STATGROUP_BoidsMove, STATCAT_Advanced);
 
+/** A contiguous run of boids inside one chunk, the unit of work of the batched forces stage */
+struct FMSBoidForcesBatch
+{
+	TConstArrayView<FMSBoidSlotFragment> Slots;
+	TArrayView<FMSBoidForcesFragment> Forces;
+	int32 Begin = 0;
+	int32 End = 0;
+};
+
 /**
  * 
  */
@@ -23,11 +33,38 @@ class MASSSAMPLE_API UMSBoidMovementProcessor : public UMassProcessor
 	virtual void ConfigureQueries() override;
 	virtual void Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context) override;
 
+	/** Forces, integration and buffer swap for one simulation step */
+	void SimulateStep(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context, float StepTime);
+
+	/** Neighbor query and force for the boids of the batch. Each index only writes its own force */
+	void CalculateForcesForRange(const FMSBoidForcesBatch& Batch) const;
+
+	/** Same as CalculateForcesForRange on top of the linear octree's SoA ranges, four neighbors per instruction */
+	void CalculateForcesForRangeVectorized(const FMSBoidForcesBatch& Batch) const;
+
+	/** Picks the player views and the step the forces LOD schedules against, once per step */
+	void PrepareForcesLOD();
+
+	/** Whether the boid's LOD bucket has its forces due this step, the slot staggers boids of a bucket over steps */
+	bool ShouldUpdateForces(const FVector& Location, int32 Slot) const;
+
+	void GatherForcesBatches(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context, int32 BatchSize);
+
+	/** Runs the forces stage once per task count from 1 to the number of workers and logs the timings */
+	void ReportForcesScaling(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context);
+
 	UPROPERTY()
 	UMSBoidSubsystem* BoidSubsystem;
 
+	TArray<FMSBoidForcesBatch> ForcesBatches;
+
+	bool bForcesLODActive = false;
+	uint32 ForcesLODStep = 0;
+	float ForcesLODMediumDistanceSquared = 0.0f;
+	float ForcesLODFarDistanceSquared = 0.0f;
+	TArray<FVector> ForcesLODViewLocations;
+
 	FMassEntityQuery CalculateForcesQuery;
-	FMassEntityQuery CalculateVelocityQuery;
+	FMassEntityQuery IntegrateBoidsQuery;
 	FMassEntityQuery RotateBoidsQuery;
-	FMassEntityQuery MoveBoidsQuery;
 };
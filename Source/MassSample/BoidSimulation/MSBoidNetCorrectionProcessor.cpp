@@ -0,0 +1,59 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MSBoidNetCorrectionProcessor.h"
+
+#include "MassCommonTypes.h"
+#include "MSBoidFragments.h"
+#include "MSBoidMovementProcessor.h"
+
+DECLARE_CYCLE_STAT(TEXT("Boids Move ~ Net corrections"), STAT_NetCorrections, STATGROUP_BoidsMove);
+
+UMSBoidNetCorrectionProcessor::UMSBoidNetCorrectionProcessor()
+{
+	ExecutionOrder.ExecuteBefore.Add(UE::Mass::ProcessorGroupNames::Movement);
+	ExecutionFlags = (int32)EProcessorExecutionFlags::Client;
+}
+
+void UMSBoidNetCorrectionProcessor::Initialize(UObject& Owner)
+{
+	BoidSubsystem = GetWorld()->GetSubsystem<UMSBoidSubsystem>();
+}
+
+void UMSBoidNetCorrectionProcessor::ConfigureQueries()
+{
+	CorrectionQuery.AddRequirement<FMSBoidSlotFragment>(EMassFragmentAccess::ReadOnly);
+	CorrectionQuery.AddRequirement<FMSBoidNetCorrectionFragment>(EMassFragmentAccess::ReadWrite);
+}
+
+void UMSBoidNetCorrectionProcessor::Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context)
+{
+	SCOPE_CYCLE_COUNTER(STAT_NetCorrections);
+
+	// Between steps, so the correction lands in the state the next step starts from
+	FMSBoidStateBuffer& StateBuffer = BoidSubsystem->GetMutableReadStateBuffer();
+
+	CorrectionQuery.ParallelForEachEntityChunk(EntitySubsystem, Context, [&StateBuffer](FMassExecutionContext& Context)
+	{
+		const int32 NumEntities = Context.GetNumEntities();
+		const float DeltaTime = Context.GetDeltaTimeSeconds();
+		const auto Slots = Context.GetFragmentView<FMSBoidSlotFragment>();
+		const auto Corrections = Context.GetMutableFragmentView<FMSBoidNetCorrectionFragment>();
+
+		for (int i = 0; i < NumEntities; ++i)
+		{
+			FMSBoidNetCorrectionFragment& Correction = Corrections[i];
+			if (Correction.RemainingTime <= 0.0f) continue;
+
+			// Even share of what is left over the time that is left, so the error runs out together with the time
+			const float Share = FMath::Min(DeltaTime / Correction.RemainingTime, 1.0f);
+			const FVector Step = Correction.RemainingError * Share;
+
+			StateBuffer.Locations[Slots[i].Slot] += Step;
+			Correction.RemainingError -= Step;
+			Correction.RemainingTime -= DeltaTime;
+
+			if (Correction.RemainingTime <= 0.0f) Correction.RemainingError = FVector::ZeroVector;
+		}
+	});
+}
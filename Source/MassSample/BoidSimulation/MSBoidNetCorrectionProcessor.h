@@ -0,0 +1,29 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MassProcessor.h"
+#include "MSBoidSubsystem.h"
+#include "MSBoidNetCorrectionProcessor.generated.h"
+
+/**
+ * Client side. Moves the boids a share of their pending server correction every frame, ahead of the movement step,
+ * so corrections show up as a short drift instead of a pop
+ */
+UCLASS()
+class MASSSAMPLE_API UMSBoidNetCorrectionProcessor : public UMassProcessor
+{
+	GENERATED_BODY()
+
+	UMSBoidNetCorrectionProcessor();
+
+	virtual void Initialize(UObject& Owner) override;
+	virtual void ConfigureQueries() override;
+	virtual void Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context) override;
+
+	UPROPERTY()
+	UMSBoidSubsystem* BoidSubsystem;
+
+	FMassEntityQuery CorrectionQuery;
+};
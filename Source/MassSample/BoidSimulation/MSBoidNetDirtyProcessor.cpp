@@ -0,0 +1,86 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MSBoidNetDirtyProcessor.h"
+
+#include "MSBoidFragments.h"
+#include "MSBoidMovementProcessor.h"
+#include "MSBoidSubsystem.h"
+#include "Misc/ScopeExit.h"
+#include "Misc/ScopeLock.h"
+
+DECLARE_CYCLE_STAT(TEXT("Boids Move ~ Net dirty list"), STAT_NetDirty, STATGROUP_BoidsMove);
+
+UMSBoidNetDirtyProcessor::UMSBoidNetDirtyProcessor()
+{
+	ExecutionOrder.ExecuteAfter.Add(UE::Mass::ProcessorGroupNames::Movement);
+	ExecutionFlags = (int32)(EProcessorExecutionFlags::Server | EProcessorExecutionFlags::Standalone);
+}
+
+void UMSBoidNetDirtyProcessor::Initialize(UObject& Owner)
+{
+	BoidSubsystem = GetWorld()->GetSubsystem<UMSBoidSubsystem>();
+}
+
+void UMSBoidNetDirtyProcessor::ConfigureQueries()
+{
+	DirtyQuery.AddRequirement<FMSBoidNetId>(EMassFragmentAccess::ReadOnly);
+	DirtyQuery.AddRequirement<FMSBoidSlotFragment>(EMassFragmentAccess::ReadOnly);
+}
+
+void UMSBoidNetDirtyProcessor::Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context)
+{
+	AMSBoidReplicator* Replicator = BoidSubsystem->BoidReplicator;
+
+	// Only the multicast uses the list, per connection streams keep their own record of what each client got
+	Replicator->ResetDirtyBoids();
+	if (Replicator->bPerConnectionRelevancy) return;
+	if (BoidSubsystem->IsLockstep() && !BoidSubsystem->bLockstepDesynced) return;
+
+	SCOPE_CYCLE_COUNTER(STAT_NetDirty);
+
+	const double StartTime = FPlatformTime::Seconds();
+	ON_SCOPE_EXIT { Replicator->ReplicationSeconds += FPlatformTime::Seconds() - StartTime; };
+
+	const float Now = GetWorld()->GetTimeSeconds();
+	const FMSBoidStateBuffer& StateBuffer = BoidSubsystem->GetReadStateBuffer();
+
+	DirtyQuery.ParallelForEachEntityChunk(EntitySubsystem, Context,
+		[this, Replicator, Now, &StateBuffer](FMassExecutionContext& Context)
+	{
+		const int32 NumEntities = Context.GetNumEntities();
+		const auto NetIds = Context.GetFragmentView<FMSBoidNetId>();
+		const auto Slots = Context.GetFragmentView<FMSBoidSlotFragment>();
+
+		const float Precision = Replicator->NetUpdatePrecisionTolerance;
+		const float TimeWeight = Replicator->NetPriorityTimeWeight;
+
+		// Collected per chunk so the lock is taken once per chunk rather than once per boid
+		TArray<FMSBoidNetDirtyEntry, TInlineAllocator<256>> ChunkDirtyBoids;
+
+		for (int32 i = 0; i < NumEntities; ++i)
+		{
+			const uint16 NetId = NetIds[i].Id;
+			if (!Replicator->CachedLocations.IsValidIndex(NetId)) continue;
+
+			// Movement below the wire precision would arrive as the same location, it isn't worth a send
+			const int32 Slot = Slots[i].Slot;
+			const FIntVector QuantizedLocation = Replicator->QuantizeLocation(StateBuffer.Locations[Slot]);
+			const FIntVector Error = QuantizedLocation - Replicator->CachedLocations[NetId];
+			if (Error == FIntVector::ZeroValue) continue;
+
+			const float ErrorDistance = FVector(Error).Size() * Precision;
+			const float TimeSinceSent = Now - Replicator->CachedSendTimes[NetId];
+			ChunkDirtyBoids.Add({NetId, ErrorDistance + TimeSinceSent * TimeWeight, QuantizedLocation, StateBuffer.Velocities[Slot]});
+		}
+
+		if (ChunkDirtyBoids.Num() > 0)
+		{
+			FScopeLock Lock(&DirtyBoidsLock);
+			Replicator->DirtyBoids.Append(ChunkDirtyBoids);
+		}
+	});
+
+	// Chunks finish in any order, grouping by net id lets every batch read just its slice
+	Replicator->BucketDirtyBoids();
+}
@@ -0,0 +1,31 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MassProcessor.h"
+#include "MSBoidNetDirtyProcessor.generated.h"
+
+class UMSBoidSubsystem;
+/**
+ * Server side. Compares every boid against what the multicast last sent of it at wire precision, and hands the replicator
+ * the list of boids that changed with how urgently each one should go out
+ */
+UCLASS()
+class MASSSAMPLE_API UMSBoidNetDirtyProcessor : public UMassProcessor
+{
+	GENERATED_BODY()
+
+	UMSBoidNetDirtyProcessor();
+
+	virtual void Initialize(UObject& Owner) override;
+	virtual void ConfigureQueries() override;
+	virtual void Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context) override;
+
+	FMassEntityQuery DirtyQuery;
+
+	UPROPERTY()
+	UMSBoidSubsystem* BoidSubsystem;
+
+	FCriticalSection DirtyBoidsLock;
+};
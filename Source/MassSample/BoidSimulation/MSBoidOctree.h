@@ -2,8 +2,26 @@
 
 #include "CoreMinimal.h"
 #include "Math/GenericOctree.h"
+#include "MassEntityTypes.h"
 #include "MSBoidOctree.generated.h"
 
+/** Octree element id of every boid by entity index. Lives outside chunk memory, so it survives entities moving around */
+struct FMSBoidOctreeElementIds
+{
+	TArray<FOctreeElementId2> ElementIds;
+
+	void Set(const FMassEntityHandle Entity, const FOctreeElementId2 ElementId)
+	{
+		if (!ElementIds.IsValidIndex(Entity.Index)) ElementIds.SetNum(Entity.Index + 1);
+		ElementIds[Entity.Index] = ElementId;
+	}
+
+	FOctreeElementId2 Get(const FMassEntityHandle Entity) const
+	{
+		return ElementIds.IsValidIndex(Entity.Index) ? ElementIds[Entity.Index] : FOctreeElementId2();
+	}
+};
+
 USTRUCT()
 struct FMSBoid
 {
@@ -14,10 +32,18 @@ struct FMSBoid
 	UPROPERTY() FVector Velocity;
 	UPROPERTY() uint16 Id;
 
-	FMSBoid() : Location(FVector::ZeroVector), Velocity(FVector::ZeroVector), Id(0)
+	/** Boid this element stands for, only set when the octree is updated incrementally */
+	FMassEntityHandle Entity;
+
+	/** Where the octree reports this element's id, only set along with Entity */
+	FMSBoidOctreeElementIds* ElementIds;
+
+	FMSBoid() : Location(FVector::ZeroVector), Velocity(FVector::ZeroVector), Id(0), ElementIds(nullptr)
 	{}
 
-	FMSBoid(FVector InLocation, FVector InVelocity, uint16 Id) : Location(InLocation), Velocity(InVelocity), Id(Id)
+	FMSBoid(FVector InLocation, FVector InVelocity, uint16 Id, FMassEntityHandle InEntity = FMassEntityHandle(),
+	        FMSBoidOctreeElementIds* InElementIds = nullptr)
+		: Location(InLocation), Velocity(InVelocity), Id(Id), Entity(InEntity), ElementIds(InElementIds)
 	{}
 
 	bool operator==(const FMSBoid& Other) const
@@ -52,7 +78,12 @@ struct FMSBoidOctreeSemantics
 	}
 
 	FORCEINLINE static void SetElementId(const FMSBoid& Element, FOctreeElementId2 OctreeElementID)
-	{}
+	{
+		if (Element.ElementIds)
+		{
+			Element.ElementIds->Set(Element.Entity, OctreeElementID);
+		}
+	}
 };
 
 typedef TOctree2<FMSBoid, FMSBoidOctreeSemantics> FMSBoidOctree;
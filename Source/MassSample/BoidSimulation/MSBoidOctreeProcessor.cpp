@@ -6,6 +6,11 @@
 #include "MassCommonTypes.h"
 #include "MassRepresentationTypes.h"
 #include "MSBoidFragments.h"
+#include "MSBoidMovementProcessor.h"
+
+DECLARE_CYCLE_STAT(TEXT("Boids Move ~ Octree full rebuild"), STAT_OctreeRebuild, STATGROUP_BoidsMove);
+DECLARE_CYCLE_STAT(TEXT("Boids Move ~ Octree incremental update"), STAT_OctreeIncremental, STATGROUP_BoidsMove);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Boids Move ~ Octree relocations"), STAT_OctreeRelocations, STATGROUP_BoidsMove);
 
 UMSBoidOctreeProcessor::UMSBoidOctreeProcessor()
 {
@@ -21,28 +26,164 @@ void UMSBoidOctreeProcessor::Initialize(UObject& Owner)
 
 void UMSBoidOctreeProcessor::ConfigureQueries()
 {
-	RebuildOctreeQuery.AddRequirement<FMSBoidLocationFragment>(EMassFragmentAccess::ReadOnly);
-	RebuildOctreeQuery.AddRequirement<FMSBoidVelocityFragment>(EMassFragmentAccess::ReadOnly);
+	RebuildOctreeQuery.AddRequirement<FMSBoidSlotFragment>(EMassFragmentAccess::ReadOnly);
 }
 
 void UMSBoidOctreeProcessor::Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context)
 {
-	// Reset octree each frame
+	if (BoidSubsystem->SpatialBackend != EMSBoidSpatialBackend::Octree) return;
+
+	// Spawns and destroys can reuse entity indices, so the elements only carry over while the population is the same
+	if (!BoidSubsystem->BoidSettings->bIncrementalOctree || BoidSubsystem->bOctreeElementIdsStale ||
+		OctreePopulationVersion != BoidSubsystem->BoidPopulationVersion ||
+		!UpdateOctreeIncrementally(EntitySubsystem, Context))
+	{
+		RebuildOctree(EntitySubsystem, Context);
+	}
+
+	BoidSubsystem->DrawDebugOctree();
+}
+
+void UMSBoidOctreeProcessor::RebuildOctree(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context)
+{
+	SCOPE_CYCLE_COUNTER(STAT_OctreeRebuild);
+
+	// Reset octree
 	BoidSubsystem->BoidOctree->Destroy();
+	BoidSubsystem->OctreeElementIds.ElementIds.Reset();
+	BoidSubsystem->bOctreeElementIdsStale = false;
+	OctreePopulationVersion = BoidSubsystem->BoidPopulationVersion;
+	NumBoidsInOctree = 0;
 
-	RebuildOctreeQuery.ForEachEntityChunk(EntitySubsystem, Context, [this](FMassExecutionContext& Context)
+	const FMSBoidStateBuffer& StateBuffer = BoidSubsystem->GetReadStateBuffer();
+
+	RebuildOctreeQuery.ForEachEntityChunk(EntitySubsystem, Context, [this, &StateBuffer](FMassExecutionContext& Context)
 	{
 		const int32 NumEntities = Context.GetNumEntities();
-		const auto Locations = Context.GetFragmentView<FMSBoidLocationFragment>();
-		const auto Velocities = Context.GetFragmentView<FMSBoidVelocityFragment>();
+		const auto Slots = Context.GetFragmentView<FMSBoidSlotFragment>();
 
 		for (int i = 0; i < NumEntities; ++i)
 		{
-			const FVector& Location = Locations[i].Location;
-			const FVector& Velocity = Velocities[i].Velocity;
-			BoidSubsystem->BoidOctree->AddElement(FMSBoid(Location, Velocity, 0));
+			const FVector& Location = StateBuffer.Locations[Slots[i].Slot];
+			const FVector& Velocity = StateBuffer.Velocities[Slots[i].Slot];
+			BoidSubsystem->BoidOctree->AddElement(FMSBoid(Location, Velocity, 0, Context.GetEntity(i),
+			                                              &BoidSubsystem->OctreeElementIds));
 		}
+		NumBoidsInOctree += NumEntities;
 	});
 
-	BoidSubsystem->DrawDebugOctree();
+	// Only needed to pick up incrementally from here next frame
+	if (BoidSubsystem->BoidSettings->bIncrementalOctree)
+	{
+		CacheNodeBounds();
+	}
+}
+
+bool UMSBoidOctreeProcessor::UpdateOctreeIncrementally(UMassEntitySubsystem& EntitySubsystem,
+                                                       FMassExecutionContext& Context)
+{
+	SCOPE_CYCLE_COUNTER(STAT_OctreeIncremental);
+
+	FMSBoidOctree& BoidOctree = *BoidSubsystem->BoidOctree;
+	FMSBoidOctreeElementIds& ElementIds = BoidSubsystem->OctreeElementIds;
+	const FMSBoidStateBuffer& StateBuffer = BoidSubsystem->GetReadStateBuffer();
+	int32 NumBoids = 0;
+	bool bElementsMatch = true;
+
+	Relocations.Reset();
+
+	// First pass only touches data in place, nothing gets added or removed until every boid was checked
+	RebuildOctreeQuery.ForEachEntityChunk(EntitySubsystem, Context, [&, this](FMassExecutionContext& Context)
+	{
+		const int32 NumEntities = Context.GetNumEntities();
+		const auto Slots = Context.GetFragmentView<FMSBoidSlotFragment>();
+
+		NumBoids += NumEntities;
+
+		for (int i = 0; i < NumEntities && bElementsMatch; ++i)
+		{
+			const FMassEntityHandle Entity = Context.GetEntity(i);
+			const FVector& Location = StateBuffer.Locations[Slots[i].Slot];
+			const FVector& Velocity = StateBuffer.Velocities[Slots[i].Slot];
+			const FOctreeElementId2 ElementId = ElementIds.Get(Entity);
+
+			if (!ElementId.IsValidId() || !BoidOctree.IsValidElementId(ElementId))
+			{
+				Relocations.Add({Entity, Location, Velocity});
+				continue;
+			}
+
+			FMSBoid& Boid = BoidOctree.GetElementById(ElementId);
+			if (Boid.Entity != Entity)
+			{
+				// The index belonged to a boid destroyed since, only a rebuild gets rid of its element
+				bElementsMatch = false;
+				break;
+			}
+
+			Boid.Location = Location;
+			Boid.Velocity = Velocity;
+
+			const FOctreeElementId2::FNodeIndex NodeIndex = ElementId.GetNodeIndex();
+			if (!NodeBounds.IsValidIndex(NodeIndex) || !NodeBounds[NodeIndex].IsValid ||
+				!NodeBounds[NodeIndex].IsInsideOrOn(Location))
+			{
+				Relocations.Add({Entity, Location, Velocity});
+			}
+		}
+	});
+
+	INC_DWORD_STAT_BY(STAT_OctreeRelocations, Relocations.Num());
+
+	if (!bElementsMatch || NumBoids < NumBoidsInOctree ||
+		Relocations.Num() > NumBoids * BoidSubsystem->BoidSettings->OctreeRebuildChurnThreshold)
+	{
+		return false;
+	}
+
+	if (Relocations.Num() == 0) return true;
+
+	for (const FRelocation& Relocation : Relocations)
+	{
+		// Read again every time, removing and adding moves other elements and reports their new ids
+		const FOctreeElementId2 ElementId = ElementIds.Get(Relocation.Entity);
+		if (ElementId.IsValidId() && BoidOctree.IsValidElementId(ElementId))
+		{
+			BoidOctree.RemoveElement(ElementId);
+		}
+		else
+		{
+			++NumBoidsInOctree;
+		}
+		BoidOctree.AddElement(FMSBoid(Relocation.Location, Relocation.Velocity, 0, Relocation.Entity, &ElementIds));
+	}
+
+	// Nodes may have split or collapsed, their indices can now stand for other boxes
+	CacheNodeBounds();
+
+	return true;
+}
+
+void UMSBoidOctreeProcessor::CacheNodeBounds()
+{
+	const FMSBoidOctree& BoidOctree = *BoidSubsystem->BoidOctree;
+
+	// Zeroed boxes are invalid, so indices of freed nodes never match a location
+	NodeBounds.Reset();
+
+	BoidOctree.FindNodesWithPredicate(
+		[](FMSBoidOctree::FNodeIndex ParentNodeIndex, FMSBoidOctree::FNodeIndex CurrentNodeIndex,
+		   const FBoxCenterAndExtent& Bounds)
+		{
+			return true;
+		},
+		[this](FMSBoidOctree::FNodeIndex ParentNodeIndex, FMSBoidOctree::FNodeIndex CurrentNodeIndex,
+		       const FBoxCenterAndExtent& Bounds)
+		{
+			if (!NodeBounds.IsValidIndex(CurrentNodeIndex))
+			{
+				NodeBounds.SetNumZeroed(CurrentNodeIndex + 1, false);
+			}
+			NodeBounds[CurrentNodeIndex] = Bounds.GetBox();
+		});
 }
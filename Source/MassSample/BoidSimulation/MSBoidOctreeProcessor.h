@@ -21,8 +21,35 @@ class MASSSAMPLE_API UMSBoidOctreeProcessor : public UMassProcessor
 	virtual void ConfigureQueries() override;
 	virtual void Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context) override;
 
+	void RebuildOctree(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context);
+
+	/** Refreshes boids in place and only relocates the ones that left their node. Returns false if it gave up on churn */
+	bool UpdateOctreeIncrementally(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context);
+
+	/** Walks the whole tree once and stores the bounds of every node, after anything changed the tree's layout */
+	void CacheNodeBounds();
+
 	UPROPERTY()
 	UMSBoidSubsystem* BoidSubsystem;
 
 	FMassEntityQuery RebuildOctreeQuery;
+
+	struct FRelocation
+	{
+		FMassEntityHandle Entity;
+		FVector Location;
+		FVector Velocity;
+	};
+
+	/** Boids the octree holds, a drop means entities were destroyed and their elements have to go with a rebuild */
+	int32 NumBoidsInOctree = 0;
+
+	/** Subsystem's boid population version the octree was built for, any spawn or destroy since forces a rebuild */
+	uint32 OctreePopulationVersion = 0;
+
+	/** Loose bounds of every node by node index, invalid for indices that aren't in use */
+	TArray<FBox> NodeBounds;
+
+	/** Scratch list kept between frames so the incremental update doesn't allocate once warmed up */
+	TArray<FRelocation> Relocations;
 };
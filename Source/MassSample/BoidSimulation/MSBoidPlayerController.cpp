@@ -3,6 +3,7 @@
 
 #include "MSBoidPlayerController.h"
 
+#include "MSBoidSubsystem.h"
 #include "Engine/NetDriver.h"
 #include "GameFramework/PlayerState.h"
 
@@ -19,6 +20,16 @@ void AMSBoidPlayerController::BeginPlay()
 	Super::BeginPlay();
 
 	if (GetNetDriver()) GetNetDriver()->bCollectNetStats = true;
+
+	// Remote clients missed the spawns that went out before they joined
+	if (HasAuthority() && !IsLocalController())
+	{
+		const UMSBoidSubsystem* BoidSubsystem = GetWorld()->GetSubsystem<UMSBoidSubsystem>();
+		if (BoidSubsystem && BoidSubsystem->BoidReplicator)
+		{
+			BoidSubsystem->BoidReplicator->QueueJoinSpawn(this);
+		}
+	}
 }
 
 float AMSBoidPlayerController::GetInBytes()
@@ -39,6 +50,59 @@ float AMSBoidPlayerController::GetOutBytes()
 	return 0.f;
 }
 
+float AMSBoidPlayerController::GetBoidLocationBytesPerBoid()
+{
+	const UMSBoidSubsystem* BoidSubsystem = GetWorld() ? GetWorld()->GetSubsystem<UMSBoidSubsystem>() : nullptr;
+	if (BoidSubsystem && BoidSubsystem->BoidReplicator)
+	{
+		return BoidSubsystem->BoidReplicator->GetBytesPerBoid();
+	}
+	return 0.f;
+}
+
+void AMSBoidPlayerController::ClientReceiveBoidLocations_Implementation(const FMSBoidLocationBatchNet& BoidLocations,
+                                                                        int32 ServerStepNumber)
+{
+	const UMSBoidSubsystem* BoidSubsystem = GetWorld()->GetSubsystem<UMSBoidSubsystem>();
+	if (BoidSubsystem && BoidSubsystem->BoidReplicator)
+	{
+		BoidSubsystem->BoidReplicator->ApplyLocationBatch(BoidLocations, ServerStepNumber);
+	}
+}
+
+void AMSBoidPlayerController::ClientReceiveBoidSpawn_Implementation(const TArray<FMSBoidNetSpawnData>& BoidData)
+{
+	UMSBoidSubsystem* BoidSubsystem = GetWorld()->GetSubsystem<UMSBoidSubsystem>();
+	if (!BoidSubsystem) return;
+
+	// Only late joiners get these, in lockstep that means boids it didn't simulate from the start
+	if (BoidSubsystem->IsLockstep()) BoidSubsystem->bLockstepDesynced = true;
+	BoidSubsystem->SpawnBoidsFromData(BoidData);
+}
+
+void AMSBoidPlayerController::ServerReportBoidDesync_Implementation(int32 LockstepStep)
+{
+	UMSBoidSubsystem* BoidSubsystem = GetWorld()->GetSubsystem<UMSBoidSubsystem>();
+	if (!BoidSubsystem) return;
+
+	// Reliable and client driven, a misbehaving client must not be able to flood the log or fake a desync
+	const float Now = GetWorld()->GetTimeSeconds();
+	if (Now < NextDesyncReportTime) return;
+	if (!BoidSubsystem->IsValidDesyncReport(LockstepStep))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("AMSBoidPlayerController::ServerReportBoidDesync() %s reported invalid lockstep step %d, server is at %d"),
+		       *GetName(), LockstepStep, BoidSubsystem->GetLockstepStep());
+		NextDesyncReportTime = Now + BoidSubsystem->LockstepDesyncReportCooldown;
+		return;
+	}
+	NextDesyncReportTime = Now + BoidSubsystem->LockstepDesyncReportCooldown;
+	if (BoidSubsystem->bLockstepDesynced) return;
+
+	UE_LOG(LogTemp, Warning, TEXT("AMSBoidPlayerController::ServerReportBoidDesync() %s desynced at lockstep step %d, server is at %d"),
+	       *GetName(), LockstepStep, BoidSubsystem->GetLockstepStep());
+	BoidSubsystem->bLockstepDesynced = true;
+}
+
 float AMSBoidPlayerController::GetPing()
 {
 	if (GetPlayerState<APlayerState>()) return GetPlayerState<APlayerState>()->ExactPing;
@@ -4,6 +4,7 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/PlayerController.h"
+#include "MSBoidReplicator.h"
 #include "MSBoidPlayerController.generated.h"
 
 UCLASS()
@@ -29,4 +30,24 @@ public:
 
 	UFUNCTION(BlueprintCallable)
 	float GetPing();
+
+	/** Average bytes a boid takes in the location updates this machine sends or receives */
+	UFUNCTION(BlueprintCallable)
+	float GetBoidLocationBytesPerBoid();
+
+	/** Boid locations relevant to this client only, sent instead of the replicator's multicast with per-connection relevancy */
+	UFUNCTION(Client, Unreliable)
+	void ClientReceiveBoidLocations(const FMSBoidLocationBatchNet& BoidLocations, int32 ServerStepNumber);
+
+	/** Chunk of the boids spawned before this client joined */
+	UFUNCTION(Client, Reliable)
+	void ClientReceiveBoidSpawn(const TArray<FMSBoidNetSpawnData>& BoidData);
+
+	/** Lockstep. The client's boids no longer match the server's, location updates have to take over */
+	UFUNCTION(Server, Reliable)
+	void ServerReportBoidDesync(int32 LockstepStep);
+
+private:
+	/** Server side. Desync reports from this client before then are dropped */
+	float NextDesyncReportTime = 0.0f;
 };
@@ -9,10 +9,11 @@
 #include "MSBoidMovementProcessor.h"
 #include "NiagaraDataInterfaceArrayFunctionLibrary.h"
 #include "Components/HierarchicalInstancedStaticMeshComponent.h"
+#include "Misc/ScopeLock.h"
 
 DECLARE_CYCLE_STAT(TEXT("Boids Render ~ Render"), STAT_Render, STATGROUP_BoidsRender);
 DECLARE_CYCLE_STAT(TEXT("Boids Render ~ HISM update"), STAT_HismUpdate, STATGROUP_BoidsRender);
-DECLARE_CYCLE_STAT(TEXT("Boids Render ~ Niagara array fill"), STAT_NiagaraArrayFill, STATGROUP_BoidsRender);
+DECLARE_CYCLE_STAT(TEXT("Boids Render ~ Render buffer fill"), STAT_RenderBufferFill, STATGROUP_BoidsRender);
 DECLARE_CYCLE_STAT(TEXT("Boids Render ~ Niagara update"), STAT_NiagaraUpdate, STATGROUP_BoidsRender);
 
 UMSBoidRenderProcessor::UMSBoidRenderProcessor()
@@ -28,8 +29,7 @@ void UMSBoidRenderProcessor::Initialize(UObject& Owner)
 
 void UMSBoidRenderProcessor::ConfigureQueries()
 {
-	RenderBoidsQuery.AddRequirement<FMSBoidLocationFragment>(EMassFragmentAccess::ReadOnly);
-	RenderBoidsQuery.AddRequirement<FMSBoidVelocityFragment>(EMassFragmentAccess::ReadOnly);
+	RenderBoidsQuery.AddRequirement<FMSBoidSlotFragment>(EMassFragmentAccess::ReadOnly);
 	RenderBoidsQuery.AddRequirement<FMSBoidRenderFragment>(EMassFragmentAccess::ReadOnly);
 }
 
@@ -37,55 +37,104 @@ void UMSBoidRenderProcessor::Execute(UMassEntitySubsystem& EntitySubsystem, FMas
 {
 	SCOPE_CYCLE_COUNTER(STAT_Render);
 	const UMSBoidDevSettings* const BoidSettings = GetDefault<UMSBoidDevSettings>();
-	TArray<FVector> LocationArray;
-	TArray<FVector> RotationArray;
 
-	LocationArray.SetNum(BoidSettings->NumOfBoids, false);
-	RotationArray.SetNum(BoidSettings->NumOfBoids, false);
-	
-	RenderBoidsQuery.ForEachEntityChunk(EntitySubsystem, Context, [this, BoidSettings, &LocationArray, &RotationArray](FMassExecutionContext& Context)
+	// Stable until movement swaps the buffers again, whatever else runs alongside us
+	const FMSBoidStateBuffer* RenderBuffer;
+	{
+		SCOPE_CYCLE_COUNTER(STAT_RenderBufferFill);
+		RenderBuffer = &BoidSubsystem->UpdateRenderStateBuffer();
+	}
+
+	if (BoidSettings->UseNiagara)
+	{
+		// Slots are dense, so the buffer already is the array Niagara wants and this is its only copy.
+		// The system asset reads positions and rotations as two separate user arrays, so they stay two streams.
+		SCOPE_CYCLE_COUNTER(STAT_NiagaraUpdate);
+		UNiagaraDataInterfaceArrayFunctionLibrary::SetNiagaraArrayVector(BoidSubsystem->NiagaraComponent,"MassBoidPositions", RenderBuffer->Locations);
+		UNiagaraDataInterfaceArrayFunctionLibrary::SetNiagaraArrayVector(BoidSubsystem->NiagaraComponent,"MassBoidRotations", RenderBuffer->Velocities);
+		return;
+	}
+
+	if (BoidSubsystem->Hism)
+	{
+		UpdateHismInstances(EntitySubsystem, Context, *RenderBuffer);
+	}
+}
+
+void UMSBoidRenderProcessor::UpdateHismInstances(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context,
+                                                 const FMSBoidStateBuffer& RenderBuffer)
+{
+	SCOPE_CYCLE_COUNTER(STAT_HismUpdate);
+	UHierarchicalInstancedStaticMeshComponent* Hism = BoidSubsystem->Hism;
+
+	// Without a new step or a different blend nothing moved since the last push, a resized HISM means new boids
+	const uint32 SimulationStep = BoidSubsystem->GetSimulationStep();
+	const float InterpolationAlpha = BoidSubsystem->GetInterpolationAlpha();
+	const int32 NumInstances = Hism->GetInstanceCount();
+	if (SimulationStep == LastPushedStep && InterpolationAlpha == LastPushedAlpha &&
+		NumInstances == InstanceTransforms.Num())
+	{
+		return;
+	}
+	LastPushedStep = SimulationStep;
+	LastPushedAlpha = InterpolationAlpha;
+
+	// Never shrink, the number of instances barely changes from one frame to the next
+	InstanceTransforms.SetNum(NumInstances, false);
+	DirtyBegin = NumInstances;
+	DirtyEnd = 0;
+
+	RenderBoidsQuery.ParallelForEachEntityChunk(EntitySubsystem, Context,
+		[this, &RenderBuffer, NumInstances](FMassExecutionContext& Context)
 	{
 		const int32 NumEntities = Context.GetNumEntities();
-		const auto Locations = Context.GetFragmentView<FMSBoidLocationFragment>();
-		const auto Velocities = Context.GetFragmentView<FMSBoidVelocityFragment>();
+		const auto Slots = Context.GetFragmentView<FMSBoidSlotFragment>();
 		const auto HismIndexes = Context.GetFragmentView<FMSBoidRenderFragment>();
 
+		int32 ChunkBegin = NumInstances;
+		int32 ChunkEnd = 0;
+
 		for (int i = 0; i < NumEntities; ++i)
 		{
-			const FVector& Location = Locations[i].Location;
-			const FVector& Velocity = Velocities[i].Velocity;
-			const uint32 HismIndex = HismIndexes[i].HismId;
-
-			if (BoidSettings->UseNiagara)
-			{
-				SCOPE_CYCLE_COUNTER(STAT_NiagaraArrayFill);
-				LocationArray[i] = Location;
-				RotationArray[i] = Velocity;
-			}
-			else
-			{
-				SCOPE_CYCLE_COUNTER(STAT_HismUpdate);
-				BoidSubsystem->Hism->UpdateInstanceTransform(
-					HismIndex,
-					FTransform(FRotator(Velocity.X, Velocity.Y, Velocity.Z), Location, FVector(1)),
-					//FTransform(Location),
-					true,
-					false,
-					true
-				);
-			}
+			const int32 HismIndex = HismIndexes[i].HismId;
+			if (HismIndex < 0 || HismIndex >= NumInstances) continue;
+
+			const int32 Slot = Slots[i].Slot;
+			const FVector& Velocity = RenderBuffer.Velocities[Slot];
+
+			// Nose along the velocity, a boid standing still keeps the mesh's own orientation
+			const FQuat Rotation = Velocity.IsNearlyZero() ? FQuat::Identity : Velocity.ToOrientationQuat();
+			const FTransform Transform(Rotation, RenderBuffer.Locations[Slot]);
+
+			// The HISM already has what we pushed last time, only instances that moved since make the range
+			FTransform& InstanceTransform = InstanceTransforms[HismIndex];
+			if (InstanceTransform.Equals(Transform, 0.0f)) continue;
+			InstanceTransform = Transform;
+
+			ChunkBegin = FMath::Min(ChunkBegin, HismIndex);
+			ChunkEnd = FMath::Max(ChunkEnd, HismIndex + 1);
+		}
+
+		if (ChunkBegin < ChunkEnd)
+		{
+			FScopeLock Lock(&DirtyRangeLock);
+			DirtyBegin = FMath::Min(DirtyBegin, ChunkBegin);
+			DirtyEnd = FMath::Max(DirtyEnd, ChunkEnd);
 		}
 	});
 
-	if (BoidSettings->UseNiagara)
+	if (DirtyBegin >= DirtyEnd) return;
+
+	// One call for the whole range, which also marks the render state dirty once instead of once per instance
+	if (DirtyBegin == 0 && DirtyEnd == NumInstances)
 	{
-		SCOPE_CYCLE_COUNTER(STAT_NiagaraUpdate);
-		UNiagaraDataInterfaceArrayFunctionLibrary::SetNiagaraArrayVector(BoidSubsystem->NiagaraComponent,"MassBoidPositions", LocationArray);
-		UNiagaraDataInterfaceArrayFunctionLibrary::SetNiagaraArrayVector(BoidSubsystem->NiagaraComponent,"MassBoidRotations", RotationArray);
+		Hism->BatchUpdateInstancesTransforms(0, InstanceTransforms, true, true, true);
 	}
 	else
 	{
-		if (BoidSubsystem && BoidSubsystem->Hism)
-        		BoidSubsystem->Hism->MarkRenderTransformDirty();
+		// The 5.0 API only takes a TArray, the scratch copy keeps its allocation so only the dirty range is copied
+		DirtyTransforms.Reset();
+		DirtyTransforms.Append(MakeArrayView(InstanceTransforms).Slice(DirtyBegin, DirtyEnd - DirtyBegin));
+		Hism->BatchUpdateInstancesTransforms(DirtyBegin, DirtyTransforms, true, true, true);
 	}
 }
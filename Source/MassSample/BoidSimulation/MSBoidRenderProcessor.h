@@ -3,12 +3,14 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
 #include "MassProcessor.h"
 #include "MSBoidRenderProcessor.generated.h"
 
 DECLARE_STATS_GROUP(TEXT("BoidsRender"), STATGROUP_BoidsRender, STATCAT_Advanced);
 
 class UMSBoidSubsystem;
+struct FMSBoidStateBuffer;
 /**
  * 
  */
@@ -23,8 +25,27 @@ class MASSSAMPLE_API UMSBoidRenderProcessor : public UMassProcessor
 	virtual void ConfigureQueries() override;
 	virtual void Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context) override;
 
+	/** Builds the transforms of every boid instance in parallel and pushes the range that changed in one batched update */
+	void UpdateHismInstances(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context,
+	                         const FMSBoidStateBuffer& RenderBuffer);
+
 	UPROPERTY()
 	UMSBoidSubsystem* BoidSubsystem;
 
 	FMassEntityQuery RenderBoidsQuery;
+
+	/** Transform of every HISM instance as last pushed, indexed by FMSBoidRenderFragment::HismId */
+	TArray<FTransform> InstanceTransforms;
+
+	/** Transforms of a partial dirty range, handed to the HISM */
+	TArray<FTransform> DirtyTransforms;
+
+	/** Instances whose transform changed this frame, [DirtyBegin, DirtyEnd), merged across chunks under DirtyRangeLock */
+	int32 DirtyBegin = 0;
+	int32 DirtyEnd = 0;
+	FCriticalSection DirtyRangeLock;
+
+	/** Simulation step and interpolation alpha the instances were last pushed for, nothing moved if both still match */
+	uint32 LastPushedStep = 0;
+	float LastPushedAlpha = -1.0f;
 };
@@ -5,9 +5,305 @@
 
 #include "MSBoidFragments.h"
 #include "MSBoidOctree.h"
+#include "MSBoidPlayerController.h"
 #include "MSBoidSubsystem.h"
 #include "Engine/NetDriver.h"
+#include "GameFramework/PlayerState.h"
 #include "Kismet/GameplayStatics.h"
+#include "Misc/ScopeExit.h"
+#include "Serialization/BitWriter.h"
+
+namespace MSBoidNet
+{
+	static constexpr int32 SequenceBits = 3;
+	static constexpr uint32 SequenceMask = (1 << SequenceBits) - 1;
+	static constexpr int32 WidthBits = 6;
+	/** Steps under 1 cm/s and 1.3 degrees at the default max speed, a client's own flocking drifts more than that */
+	static constexpr int32 SpeedBits = 6;
+	static constexpr int32 ComponentBits = 6;
+	static constexpr int32 MaxEntries = 1 << 16;
+	/** Way above what a full batch packs to, anything longer is malformed */
+	static constexpr int32 MaxPayloadBits = MaxEntries * 160;
+	static constexpr float Sqrt2 = 1.41421356f;
+
+	FORCEINLINE uint32 ZigZagEncode(const int32 Value)
+	{
+		return ((uint32)Value << 1) ^ (uint32)(Value >> 31);
+	}
+
+	FORCEINLINE int32 ZigZagDecode(const uint32 Value)
+	{
+		return (int32)((Value >> 1) ^ (0u - (Value & 1)));
+	}
+
+	FORCEINLINE uint32 BitsNeeded(const uint32 Value)
+	{
+		return 32 - FMath::CountLeadingZeros(Value);
+	}
+
+	/** Writes or reads the lower NumBits of Value, anything above them comes back zeroed */
+	FORCEINLINE void SerializeBitsOf(FArchive& Ar, uint32& Value, const int32 NumBits)
+	{
+		if (Ar.IsLoading()) Value = 0;
+		if (NumBits == 0) return;
+
+		Ar.SerializeBits(&Value, NumBits);
+		if (Ar.IsLoading() && NumBits < 32) Value &= (1u << NumBits) - 1;
+	}
+
+	/** Maps a component of a unit vector that isn't its largest, so within +-1/sqrt(2), onto [0, Max] */
+	FORCEINLINE uint32 QuantizeSmallComponent(const float Component, const uint32 Max)
+	{
+		const float Normalized = (Component * Sqrt2 + 1.0f) * 0.5f;
+		return (uint32)FMath::Clamp(FMath::RoundToInt(Normalized * Max), 0, (int32)Max);
+	}
+
+	FORCEINLINE float DequantizeSmallComponent(const uint32 Value, const uint32 Max)
+	{
+		return ((float)Value / Max * 2.0f - 1.0f) / Sqrt2;
+	}
+
+	/**
+	 * Smallest three encoding of the velocity direction: the largest component is dropped and rebuilt from the other
+	 * two, which then only need to cover +-1/sqrt(2). The speed goes separately, quantized against MaxSpeed.
+	 */
+	void SerializeVelocity(FArchive& Ar, FVector& Velocity, const float MaxSpeed)
+	{
+		const uint32 SpeedMax = (1 << SpeedBits) - 1;
+		const uint32 ComponentMax = (1 << ComponentBits) - 1;
+
+		uint32 Speed = 0;
+		uint32 Largest = 0;
+		uint32 Negative = 0;
+		uint32 Small[2] = {0, 0};
+
+		if (Ar.IsSaving() && MaxSpeed > 0.0f)
+		{
+			const float Size = Velocity.Size();
+			Speed = (uint32)FMath::Clamp(FMath::RoundToInt(Size / MaxSpeed * SpeedMax), 0, (int32)SpeedMax);
+
+			if (Speed > 0)
+			{
+				const FVector Direction = Velocity / Size;
+				const FVector Abs = Direction.GetAbs();
+				Largest = Abs.X >= Abs.Y && Abs.X >= Abs.Z ? 0 : (Abs.Y >= Abs.Z ? 1 : 2);
+				Negative = Direction[Largest] < 0.0f;
+				Small[0] = QuantizeSmallComponent(Direction[(Largest + 1) % 3], ComponentMax);
+				Small[1] = QuantizeSmallComponent(Direction[(Largest + 2) % 3], ComponentMax);
+			}
+		}
+
+		SerializeBitsOf(Ar, Speed, SpeedBits);
+		if (Speed == 0)
+		{
+			if (Ar.IsLoading()) Velocity = FVector::ZeroVector;
+			return;
+		}
+
+		SerializeBitsOf(Ar, Largest, 2);
+		SerializeBitsOf(Ar, Negative, 1);
+		SerializeBitsOf(Ar, Small[0], ComponentBits);
+		SerializeBitsOf(Ar, Small[1], ComponentBits);
+
+		if (Ar.IsLoading())
+		{
+			if (Largest > 2)
+			{
+				Ar.SetError();
+				return;
+			}
+
+			FVector Direction;
+			Direction[(Largest + 1) % 3] = DequantizeSmallComponent(Small[0], ComponentMax);
+			Direction[(Largest + 2) % 3] = DequantizeSmallComponent(Small[1], ComponentMax);
+			const float LargestSquared = 1.0f - FMath::Square(Direction[(Largest + 1) % 3]) -
+				FMath::Square(Direction[(Largest + 2) % 3]);
+			Direction[Largest] = FMath::Sqrt(FMath::Max(LargestSquared, 0.0f)) * (Negative ? -1.0f : 1.0f);
+
+			Velocity = Direction * ((float)Speed / SpeedMax * MaxSpeed);
+		}
+	}
+}
+
+void FMSBoidLocationBatchNet::Pack()
+{
+	FBitWriter Writer(0, true);
+	SerializePayload(Writer);
+	NumSerializedBits = Writer.GetNumBits();
+	PackedPayload = *Writer.GetBuffer();
+}
+
+void FMSBoidLocationBatchNet::Reset()
+{
+	Entries.Reset();
+	PackedPayload.Reset();
+	NumSerializedBits = 0;
+}
+
+bool FMSBoidLocationBatchNet::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+	using namespace MSBoidNet;
+
+	// Usually packed by the replicator already, then every connection only copies the same bits
+	if (Ar.IsSaving())
+	{
+		if (PackedPayload.Num() == 0) Pack();
+
+		uint32 NumBits = NumSerializedBits;
+		Ar.SerializeIntPacked(NumBits);
+		Ar.SerializeBits(PackedPayload.GetData(), NumBits);
+		bOutSuccess = !Ar.IsError();
+		return true;
+	}
+
+	uint32 NumBits = 0;
+	Ar.SerializeIntPacked(NumBits);
+	if (Ar.IsError() || NumBits > (uint32)MaxPayloadBits)
+	{
+		bOutSuccess = false;
+		return true;
+	}
+
+	TArray<uint8> Payload;
+	Payload.SetNumZeroed(FMath::DivideAndRoundUp(NumBits, 8u));
+	Ar.SerializeBits(Payload.GetData(), NumBits);
+	if (Ar.IsError())
+	{
+		bOutSuccess = false;
+		return true;
+	}
+
+	NumSerializedBits = NumBits;
+	FBitReader Reader(Payload.GetData(), NumBits);
+	bOutSuccess = SerializePayload(Reader);
+	return true;
+}
+
+bool FMSBoidLocationBatchNet::SerializePayload(FArchive& Ar)
+{
+	using namespace MSBoidNet;
+
+	uint32 Header = (bAbsolute ? 1 : 0) | (BaselineSequence & SequenceMask) << 1;
+	SerializeBitsOf(Ar, Header, 1 + SequenceBits);
+	bAbsolute = (Header & 1) != 0;
+	BaselineSequence = (Header >> 1) & SequenceMask;
+
+	uint32 MaxSpeedPacked = FMath::CeilToInt(MaxSpeed);
+	Ar.SerializeIntPacked(MaxSpeedPacked);
+	MaxSpeed = MaxSpeedPacked;
+
+	// Ids as runs of consecutive ids, each one the gap since the end of the previous run and its length
+	uint32 NumRuns = 0;
+	if (Ar.IsSaving())
+	{
+		for (int32 i = 0; i < Entries.Num(); ++i)
+		{
+			if (i == 0 || Entries[i].BoidId != Entries[i - 1].BoidId + 1) ++NumRuns;
+		}
+	}
+	Ar.SerializeIntPacked(NumRuns);
+
+	if (Ar.IsLoading())
+	{
+		if (NumRuns > (uint32)MaxEntries)
+		{
+			return false;
+		}
+		Entries.Reset();
+	}
+
+	uint32 NextId = 0;
+	int32 EntryIndex = 0;
+	for (uint32 Run = 0; Run < NumRuns; ++Run)
+	{
+		uint32 Gap = 0;
+		uint32 Length = 0;
+		if (Ar.IsSaving())
+		{
+			const int32 RunStart = EntryIndex;
+			while (++EntryIndex < Entries.Num() && Entries[EntryIndex].BoidId == Entries[EntryIndex - 1].BoidId + 1) {}
+
+			Gap = Entries[RunStart].BoidId - NextId;
+			Length = EntryIndex - RunStart;
+		}
+
+		// Runs are never empty, so the length goes as one less
+		uint32 LengthMinusOne = Length - 1;
+		Ar.SerializeIntPacked(Gap);
+		Ar.SerializeIntPacked(LengthMinusOne);
+		Length = LengthMinusOne + 1;
+
+		if (Ar.IsLoading())
+		{
+			if (Ar.IsError() || NextId + Gap + Length > (uint32)MaxEntries)
+			{
+				return false;
+			}
+
+			for (uint32 i = 0; i < Length; ++i)
+			{
+				Entries.AddDefaulted_GetRef().BoidId = NextId + Gap + i;
+			}
+		}
+		NextId += Gap + Length;
+	}
+
+	// Fewest bits that hold every entry's zigzagged location on each axis
+	uint32 Widths[3] = {0, 0, 0};
+	if (Ar.IsSaving())
+	{
+		for (const FMSBoidLocationNetEntry& Entry : Entries)
+		{
+			for (int32 Axis = 0; Axis < 3; ++Axis)
+			{
+				Widths[Axis] = FMath::Max(Widths[Axis], BitsNeeded(ZigZagEncode(Entry.Location[Axis])));
+			}
+		}
+	}
+	for (int32 Axis = 0; Axis < 3; ++Axis)
+	{
+		SerializeBitsOf(Ar, Widths[Axis], WidthBits);
+		if (Widths[Axis] > 32)
+		{
+			return false;
+		}
+	}
+
+	for (FMSBoidLocationNetEntry& Entry : Entries)
+	{
+		for (int32 Axis = 0; Axis < 3; ++Axis)
+		{
+			uint32 Value = ZigZagEncode(Entry.Location[Axis]);
+			SerializeBitsOf(Ar, Value, Widths[Axis]);
+			Entry.Location[Axis] = ZigZagDecode(Value);
+		}
+		if (bAbsolute) SerializeVelocity(Ar, Entry.Velocity, MaxSpeed);
+	}
+
+	return !Ar.IsError();
+}
+
+void FMSBoidLocationStream::Add(const uint16 BoidId, const FIntVector& QuantizedLocation, const FVector& Velocity,
+                                const bool bKeyframe, const uint8 KeyframeSequence, const int32 StepNumber)
+{
+	AbsoluteBatch.BaselineSequence = KeyframeSequence;
+	DeltaBatch.BaselineSequence = KeyframeSequence;
+
+	if (!Baselines.IsValidIndex(BoidId)) Baselines.SetNum(BoidId + 1);
+
+	FMSBoidNetBaseline& Baseline = Baselines[BoidId];
+	// The sequence alone can't tell a baseline from 8 keyframes ago, the step can
+	if (bKeyframe || Baseline.Sequence != KeyframeSequence || StepNumber - Baseline.StepNumber >= MaxBaselineAge)
+	{
+		Baseline = {QuantizedLocation, KeyframeSequence, StepNumber};
+		AbsoluteBatch.Entries.Add({BoidId, QuantizedLocation, Velocity});
+	}
+	else
+	{
+		// Velocities only go with absolute entries, in between the client's own flocking keeps them
+		DeltaBatch.Entries.Add({BoidId, QuantizedLocation - Baseline.Location, FVector::ZeroVector});
+	}
+}
 
 
 // Sets default values
@@ -22,92 +318,271 @@ void AMSBoidReplicator::CheckLocations()
 {
 	if (GetNetMode() == ENetMode::NM_Client) return;
 	StepNumber++;
+
+	const double StartTime = FPlatformTime::Seconds();
+	ON_SCOPE_EXIT { ReplicationSeconds += FPlatformTime::Seconds() - StartTime; };
+
+	// Peers in lockstep already have the same boids, locations only go out once some of them drifted apart
+	if (BoidSubsystem->IsLockstep() && !BoidSubsystem->bLockstepDesynced) return;
 	
-	if (Boids.Num() == 0) return;
-	
-	// Calculate how many Boids are pending update from the array
-	int BoidsPendingUpdate = Boids.Num() - CurrentBoidIndex;
-	
-	if (BoidsPendingUpdate == 0) return;
-	
-	// Calculate how many batches are remaining
-	uint8 BatchesRemaining = BatchesPerUpdate - CurrentBatchIndex;
-	
-	// Distribute evenly the remaining Boids between the remaining batches
-	int BoidsToUpdateThisBatch = BoidsPendingUpdate / BatchesRemaining;
-	
-	// If there are so few Boids that it's less than one per batch (thus, 0), update them all
-	if (BoidsToUpdateThisBatch == 0)
+	const int32 NumNetIds = BoidSubsystem->GetNetIdCapacity();
+	if (NumNetIds == 0) return;
+
+	// Every batch covers its own range of ids, so a full update goes over all of them once
+	const int32 IdsPerBatch = FMath::DivideAndRoundUp(NumNetIds, (int32)BatchesPerUpdate);
+	const int32 SliceBegin = CurrentBatchIndex * IdsPerBatch;
+	const int32 SliceEnd = FMath::Min(SliceBegin + IdsPerBatch, NumNetIds);
+
+	// Keyframe updates send every boid absolute, the deltas of the following updates are taken against them
+	const uint32 Cycle = UpdateCycle;
+	const bool bKeyframe = Cycle % NetKeyframeInterval == 0;
+	const uint8 KeyframeSequence = (Cycle / NetKeyframeInterval) & MSBoidNet::SequenceMask;
+
+	if (bPerConnectionRelevancy)
 	{
-		BoidsToUpdateThisBatch = BoidsPendingUpdate;
+		// One counting sort of every boid per batch, then each client only visits the cells around its view
+		const FMSBoidStateBuffer& StateBuffer = BoidSubsystem->GetReadStateBuffer();
+		RelevancyGrid.Build(BoidSubsystem->GetSlotEntities(), StateBuffer.Locations, StateBuffer.Velocities,
+		                    FMath::Max(NetRelevancyNearDistance, 1.0f));
 	}
+	else
+	{
+		ReplicateDirtyBoids(SliceBegin, SliceEnd, bKeyframe, KeyframeSequence);
+	}
+
+	CurrentBatchIndex = (CurrentBatchIndex + 1) % BatchesPerUpdate;
+	if (CurrentBatchIndex == 0) ++UpdateCycle;
 	
-	int LastBoidToUpdateIndex = BoidsToUpdateThisBatch + CurrentBoidIndex;
-	
-	// Loop from the current Boid until we finish this batch or arrive to the end of the array
-	while (
-		(CurrentBoidIndex < LastBoidToUpdateIndex) &&
-		(CurrentBoidIndex < Boids.Num())
-		)
-	{
-		uint16 CurrentBoidId = Boids[CurrentBoidIndex].Id;
-		FMassEntityHandle* CurrentBoid = BoidSubsystem->NetIdMassHandleMap.Find(CurrentBoidId);
-
-		UMassEntitySubsystem* MassSubsystem = GetWorld()->GetSubsystem<UMassEntitySubsystem>();
-		const FVector& Location = MassSubsystem->GetFragmentDataChecked<FMSBoidLocationFragment>(*CurrentBoid).
-		                                  Location;
-
-		const FVector& Velocity = MassSubsystem->GetFragmentDataChecked<FMSBoidVelocityFragment>(*CurrentBoid).Velocity;
-		
-		FMSBoidCachedLocation* CachedLocation = CachedBoidLocations.Find(CurrentBoidId);
-	
-		// UE_LOG(LogTemp, Error, TEXT("ARTSBoidLocationReplicator CurrentBoid is Valid"));
-		
-		if (!CachedLocation)
-		{
-			CachedBoidLocations.Emplace(CurrentBoidId, FMSBoidCachedLocation(
-				Location.X,
-				Location.Y,
-				Location.Z
-				));
-	
-			CurrentBatchIndex = (CurrentBatchIndex + 1) % BatchesPerUpdate;
-			continue;
+	if (bPerConnectionRelevancy)
+	{
+		for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; ++It)
+		{
+			// The server's own player sees the simulation itself
+			AMSBoidPlayerController* PlayerController = Cast<AMSBoidPlayerController>(It->Get());
+			if (PlayerController && !PlayerController->IsLocalController())
+			{
+				ReplicateToConnection(PlayerController, Connections.FindOrAdd(PlayerController), Cycle, bKeyframe,
+				                      KeyframeSequence, SliceBegin, SliceEnd);
+			}
 		}
-		
-		if (CachedLocation->LocationX != Location.X || CachedLocation->LocationY != Location.Y || CachedLocation->LocationZ != Location.Z)
+
+		for (auto It = Connections.CreateIterator(); It; ++It)
 		{
-			// Cache new location
-			CachedLocation->LocationX = Location.X;
-			CachedLocation->LocationY = Location.Y;
-			CachedLocation->LocationZ = Location.Z;
-	
-			// Add new location to array for update
-			BoidsToUpdate.Push(FMSBoidLocationNet(
-				Location.X / NetUpdatePrecisionTolerance,
-				Location.Y / NetUpdatePrecisionTolerance,
-				Location.Z / NetUpdatePrecisionTolerance,
-				CurrentBoidId,
-				Velocity
-			));
+			if (!It.Key().IsValid()) It.RemoveCurrent();
 		}
-	
-		// Increment the CurrentBoidIndex but never surpass the array length
-		CurrentBoidIndex = (CurrentBoidIndex + 1) % Boids.Num();
-	
-		//to avoid infinite loops, break if after incrementing the Boid index is 0 again
-		if (CurrentBoidIndex == 0) break;
 	}
-	
-	CurrentBatchIndex = (CurrentBatchIndex + 1) % BatchesPerUpdate;
-	
-	//Ensure that every new update starts from the first Boid
-	if (CurrentBatchIndex == 0) CurrentBoidIndex = 0;
-	
-	if (BoidsToUpdate.Num() > 0) NetCastLocations(BoidsToUpdate, StepNumber);
+	else
+	{
+		SendLocationBatch(MulticastStream.AbsoluteBatch);
+		SendLocationBatch(MulticastStream.DeltaBatch);
+	}
 	UE_LOG(LogTemp, Error, TEXT("ARTSBoidLocationReplicator. Server Sent update no. %d at time %f"), StepNumber, UGameplayStatics::GetRealTimeSeconds(GetWorld()));
-	
-	BoidsToUpdate.Empty();
+}
+
+FIntVector AMSBoidReplicator::QuantizeLocation(const FVector& Location) const
+{
+	return FIntVector(
+		FMath::RoundToInt(Location.X / NetUpdatePrecisionTolerance),
+		FMath::RoundToInt(Location.Y / NetUpdatePrecisionTolerance),
+		FMath::RoundToInt(Location.Z / NetUpdatePrecisionTolerance)
+	);
+}
+
+void AMSBoidReplicator::BucketDirtyBoids()
+{
+	// Counting sort on the block of every net id, linear in the dirty boids
+	const int32 NumBlocks = (BoidSubsystem->GetNetIdCapacity() >> DirtyBlockBits) + 1;
+	DirtyBlockStarts.Reset();
+	DirtyBlockStarts.SetNumZeroed(NumBlocks + 1);
+	for (const FMSBoidNetDirtyEntry& Dirty : DirtyBoids)
+	{
+		++DirtyBlockStarts[(Dirty.BoidId >> DirtyBlockBits) + 1];
+	}
+	for (int32 Block = 0; Block < NumBlocks; ++Block)
+	{
+		DirtyBlockStarts[Block + 1] += DirtyBlockStarts[Block];
+	}
+
+	TArray<int32, TInlineAllocator<256>> WriteIndices(DirtyBlockStarts.GetData(), NumBlocks);
+	BucketedDirtyBoids.SetNumUninitialized(DirtyBoids.Num(), false);
+	for (const FMSBoidNetDirtyEntry& Dirty : DirtyBoids)
+	{
+		BucketedDirtyBoids[WriteIndices[Dirty.BoidId >> DirtyBlockBits]++] = Dirty;
+	}
+	Swap(DirtyBoids, BucketedDirtyBoids);
+}
+
+void AMSBoidReplicator::ResetDirtyBoids()
+{
+	DirtyBoids.Reset();
+	DirtyBlockStarts.Reset();
+}
+
+void AMSBoidReplicator::ReplicateDirtyBoids(const int32 SliceBegin, const int32 SliceEnd, const bool bKeyframe,
+                                            const uint8 KeyframeSequence)
+{
+	RelevantBoids.Reset();
+	if (DirtyBlockStarts.Num() < 2 || SliceBegin >= SliceEnd) return;
+
+	// Only the blocks overlapping the slice are read, the ones at its edges are filtered by id
+	const int32 NumBlocks = DirtyBlockStarts.Num() - 1;
+	const int32 FirstBlock = SliceBegin >> DirtyBlockBits;
+	const int32 EndBlock = FMath::Min(((SliceEnd - 1) >> DirtyBlockBits) + 1, NumBlocks);
+	if (FirstBlock >= EndBlock) return;
+
+	for (int32 i = DirtyBlockStarts[FirstBlock]; i < DirtyBlockStarts[EndBlock]; ++i)
+	{
+		const FMSBoidNetDirtyEntry& Dirty = DirtyBoids[i];
+		if (Dirty.BoidId >= SliceBegin && Dirty.BoidId < SliceEnd) RelevantBoids.Emplace(Dirty.Priority, i);
+	}
+
+	// Whatever doesn't fit keeps gaining priority while it waits for the boid's next turn
+	if (NetMulticastBytesBudgetPerBatch > 0)
+	{
+		const float AverageBytesPerBoid = BytesPerBoid > 0.0f ? BytesPerBoid : 8.0f;
+		const int32 MaxBoids = FMath::Max(1, FMath::FloorToInt(NetMulticastBytesBudgetPerBatch / AverageBytesPerBoid));
+		if (RelevantBoids.Num() > MaxBoids)
+		{
+			RelevantBoids.Sort([](const TPair<float, int32>& A, const TPair<float, int32>& B)
+			{
+				return A.Key > B.Key;
+			});
+			RelevantBoids.SetNum(MaxBoids, false);
+		}
+	}
+
+	const float Now = GetWorld()->GetTimeSeconds();
+	for (const TPair<float, int32>& Relevant : RelevantBoids)
+	{
+		const FMSBoidNetDirtyEntry& Dirty = DirtyBoids[Relevant.Value];
+		CachedLocations[Dirty.BoidId] = Dirty.QuantizedLocation;
+		CachedSendTimes[Dirty.BoidId] = Now;
+
+		// Boids without a baseline from the current keyframe go absolute, which gives them one
+		MulticastStream.Add(Dirty.BoidId, Dirty.QuantizedLocation, Dirty.Velocity, bKeyframe, KeyframeSequence,
+		                    StepNumber, GetMaxBaselineAge());
+	}
+}
+
+void AMSBoidReplicator::ReplicateToConnection(AMSBoidPlayerController* PlayerController,
+                                              FMSBoidConnectionState& Connection, const uint32 Cycle,
+                                              const bool bKeyframe, const uint8 KeyframeSequence,
+                                              const int32 SliceBegin, const int32 SliceEnd)
+{
+	FVector ViewLocation;
+	FRotator ViewRotation;
+	PlayerController->GetPlayerViewPoint(ViewLocation, ViewRotation);
+
+	const float NearDistanceSquared = FMath::Square(NetRelevancyNearDistance);
+
+	CandidateBoids.Reset();
+	RelevantBoids.Reset();
+
+	// Boids past the far distance are never visited, the grid only hands out the cells around the view
+	RelevancyGrid.ForEachEntryInRadius(ViewLocation, NetRelevancyFarDistance, [&](const FMSBoidHashGridEntry& Entry)
+	{
+		const uint16 BoidId = BoidSubsystem->GetBoidNetId(Entry.Entity);
+		const bool bInSlice = BoidId >= SliceBegin && BoidId < SliceEnd;
+		const float DistanceSquared = FVector::DistSquared(ViewLocation, Entry.Location);
+
+		// Near boids go with every batch. The others wait for their slice, and the id staggers the medium ones over
+		// the cycles so they don't all come due in the same one
+		if (DistanceSquared > NearDistanceSquared &&
+			(!bInSlice || (Cycle + BoidId) % NetRelevancyMediumPeriod != 0))
+		{
+			return;
+		}
+
+		// A send may have been lost, so once per keyframe the boid goes out even if it didn't move since
+		const FIntVector QuantizedLocation = QuantizeLocation(Entry.Location);
+		if (!(bKeyframe && bInSlice) && Connection.SentLocations.IsValidIndex(BoidId) &&
+			Connection.SentLocations[BoidId] == QuantizedLocation)
+		{
+			return;
+		}
+
+		RelevantBoids.Emplace(DistanceSquared, CandidateBoids.Num());
+		CandidateBoids.Add({BoidId, Entry.Location, Entry.Velocity, QuantizedLocation});
+	});
+
+	// Closest first, whatever doesn't fit waits for the boid's next turn
+	const int32 MaxBoids = FMath::Max(1, FMath::FloorToInt(NetBytesBudgetPerBatch / Connection.BytesPerBoid));
+	if (RelevantBoids.Num() > MaxBoids)
+	{
+		RelevantBoids.Sort([](const TPair<float, int32>& A, const TPair<float, int32>& B)
+		{
+			return A.Key < B.Key;
+		});
+		RelevantBoids.SetNum(MaxBoids, false);
+	}
+
+	const int32 NumNetIds = BoidSubsystem->GetNetIdCapacity();
+	for (int32 NetId = Connection.SentLocations.Num(); NetId < NumNetIds; ++NetId)
+	{
+		Connection.SentLocations.Add(FIntVector(FMSBoidConnectionState::NotSent));
+	}
+
+	for (const TPair<float, int32>& Relevant : RelevantBoids)
+	{
+		const FRelevantBoid& Boid = CandidateBoids[Relevant.Value];
+		Connection.SentLocations[Boid.BoidId] = Boid.QuantizedLocation;
+
+		// Near boids outside their slice aren't keyframed, they go absolute only without a baseline from this keyframe
+		const bool bBoidKeyframe = bKeyframe && Boid.BoidId >= SliceBegin && Boid.BoidId < SliceEnd;
+		Connection.Stream.Add(Boid.BoidId, Boid.QuantizedLocation, Boid.Velocity, bBoidKeyframe, KeyframeSequence,
+		                      StepNumber, GetMaxBaselineAge());
+	}
+
+	const int64 SentBits = SendLocationBatch(Connection.Stream.AbsoluteBatch, PlayerController) +
+		SendLocationBatch(Connection.Stream.DeltaBatch, PlayerController);
+	if (RelevantBoids.Num() > 0)
+	{
+		Connection.BytesPerBoid = FMath::Max(SentBits / 8.0f / RelevantBoids.Num(), 1.0f);
+	}
+}
+
+int64 AMSBoidReplicator::SendLocationBatch(FMSBoidLocationBatchNet& Batch, AMSBoidPlayerController* PlayerController)
+{
+	int64 Bits = 0;
+	if (Batch.Entries.Num() > 0)
+	{
+		// Sorted ids are what lets them go as runs
+		Batch.Entries.Sort([](const FMSBoidLocationNetEntry& A, const FMSBoidLocationNetEntry& B)
+		{
+			return A.BoidId < B.BoidId;
+		});
+		Batch.MaxSpeed = BoidSubsystem->BoidMaxSpeed;
+		Batch.Pack();
+
+		if (PlayerController)
+		{
+			PlayerController->ClientReceiveBoidLocations(Batch, StepNumber);
+		}
+		else
+		{
+			NetCastLocations(Batch, StepNumber);
+		}
+		Bits = RecordLocationBatch(Batch);
+	}
+
+	Batch.Reset();
+	return Bits;
+}
+
+int64 AMSBoidReplicator::RecordLocationBatch(const FMSBoidLocationBatchNet& Batch)
+{
+	const int64 Bits = Batch.NumSerializedBits;
+	RecordedBits += Bits;
+	RecordedBoids += Batch.Entries.Num();
+
+	if (++RecordedBatches >= BatchesPerUpdate)
+	{
+		BytesPerBoid = RecordedBoids > 0 ? RecordedBits / 8.0f / RecordedBoids : 0.0f;
+		RecordedBits = 0;
+		RecordedBoids = 0;
+		RecordedBatches = 0;
+	}
+	return Bits;
 }
 
 void AMSBoidReplicator::NetCastSpawnBoids_Implementation(const TArray<FMSBoidNetSpawnData>& BoidData)
@@ -119,6 +594,109 @@ void AMSBoidReplicator::NetCastSpawnBoids_Implementation(const TArray<FMSBoidNet
 	BoidSubsystem->SpawnBoidsFromData(BoidData);
 }
 
+void AMSBoidReplicator::QueueSpawn(const TArray<FMSBoidNetSpawnData>& BoidData)
+{
+	if (GetNetMode() == ENetMode::NM_Client) return;
+
+	MulticastSpawnStream.Pending.Append(BoidData);
+	if (!GetWorldTimerManager().TimerExists(SpawnStreamTimerHandle)) SendSpawnChunks();
+}
+
+void AMSBoidReplicator::QueueJoinSpawn(AMSBoidPlayerController* PlayerController)
+{
+	if (GetNetMode() == ENetMode::NM_Client) return;
+
+	// A late joiner's boids would start out of step with everybody else's. It gets the current state like any late
+	// joiner, and location updates take over for everybody the way they do after a desync.
+	if (BoidSubsystem->IsLockstep() && BoidSubsystem->HasLockstepStarted() && !BoidSubsystem->bLockstepDesynced)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("AMSBoidReplicator::QueueJoinSpawn() %s joined a lockstep simulation in progress, falling back to location updates"),
+		       *PlayerController->GetName());
+		BoidSubsystem->bLockstepDesynced = true;
+	}
+
+	// Boids still queued in the multicast stream reach the new client through it
+	FJoinSpawnStream& Stream = JoinSpawnStreams.Add(PlayerController);
+	Stream.NextNetId = 0;
+	Stream.EndNetId = BoidSubsystem->GetNetIdCapacity();
+	if (!GetWorldTimerManager().TimerExists(SpawnStreamTimerHandle)) SendSpawnChunks();
+}
+
+void AMSBoidReplicator::SendSpawnChunks()
+{
+	// Ahead of every spawn chunk, so clients drop a boid before another one can arrive with its id
+	TArray<uint16> ReleaseChunk;
+	for (int32 NumSent = 0; NumSent < PendingReleases.Num(); NumSent += NetSpawnChunkSize)
+	{
+		ReleaseChunk.Reset();
+		ReleaseChunk.Append(PendingReleases.GetData() + NumSent, FMath::Min(NetSpawnChunkSize, PendingReleases.Num() - NumSent));
+		NetCastReleaseBoids(ReleaseChunk);
+	}
+	BoidSubsystem->RecycleNetIds(PendingReleases);
+	PendingReleases.Reset();
+
+	TArray<FMSBoidNetSpawnData> Chunk;
+
+	// Capped per frame so reliable chunks don't pile up in the connections' send buffers, and each chunk stays well under
+	// the largest bunch a client accepts
+	int32 MulticastChunks = 0;
+	FSpawnStream& Multicast = MulticastSpawnStream;
+	while (MulticastChunks < NetSpawnChunksPerFrame && Multicast.NumSent < Multicast.Pending.Num())
+	{
+		const int32 ChunkSize = FMath::Min(NetSpawnChunkSize, Multicast.Pending.Num() - Multicast.NumSent);
+		Chunk.Reset();
+		Chunk.Append(Multicast.Pending.GetData() + Multicast.NumSent, ChunkSize);
+		Multicast.NumSent += ChunkSize;
+		NetCastSpawnBoids(Chunk);
+		++MulticastChunks;
+	}
+	if (Multicast.NumSent == Multicast.Pending.Num())
+	{
+		Multicast.Pending.Reset();
+		Multicast.NumSent = 0;
+	}
+
+	// The multicast chunks went to every connection too, join streams get what is left of the frame's share
+	for (auto It = JoinSpawnStreams.CreateIterator(); It; ++It)
+	{
+		AMSBoidPlayerController* PlayerController = It.Key().Get();
+		FJoinSpawnStream& Stream = It.Value();
+
+		for (int32 Chunks = MulticastChunks; PlayerController && Chunks < NetSpawnChunksPerFrame &&
+		     Stream.NextNetId < Stream.EndNetId; ++Chunks)
+		{
+			Chunk.Reset();
+			Stream.NextNetId = BoidSubsystem->GatherSpawnData(Stream.NextNetId, Stream.EndNetId, NetSpawnChunkSize, Chunk);
+			if (Chunk.Num() > 0) PlayerController->ClientReceiveBoidSpawn(Chunk);
+		}
+
+		if (!PlayerController || Stream.NextNetId >= Stream.EndNetId) It.RemoveCurrent();
+	}
+
+	if (Multicast.Pending.Num() > 0 || JoinSpawnStreams.Num() > 0)
+	{
+		SpawnStreamTimerHandle = GetWorldTimerManager().SetTimerForNextTick(this, &AMSBoidReplicator::SendSpawnChunks);
+	}
+}
+
+void AMSBoidReplicator::NetCastSpawnBoidsFromSeed_Implementation(int32 Seed, int32 FirstNetId, int32 Count,
+                                                                  int32 LockstepStep)
+{
+	FMSBoidSeedSpawn SeedSpawn;
+	SeedSpawn.Seed = Seed;
+	SeedSpawn.FirstNetId = FirstNetId;
+	SeedSpawn.Count = Count;
+	SeedSpawn.LockstepStep = LockstepStep;
+	BoidSubsystem->SpawnBoidsFromSeed(SeedSpawn);
+}
+
+void AMSBoidReplicator::NetCastStepChecksum_Implementation(int32 LockstepStep, uint32 Checksum)
+{
+	if (GetNetMode() != ENetMode::NM_Client) return;
+
+	BoidSubsystem->ReceiveServerChecksum(LockstepStep, Checksum);
+}
+
 void AMSBoidReplicator::StartUpdates()
 {
 	if (GetNetMode() == ENetMode::NM_Client) return;
@@ -144,15 +722,65 @@ void AMSBoidReplicator::StopUpdates()
 void AMSBoidReplicator::AddBoid(const FMSBoid& Boid)
 {
 	if (GetNetMode() == ENetMode::NM_Client) return;
-	this->Boids.Push(Boid);
+
+	// Clients got the spawn location with the spawn itself, so it only needs sending once the boid moves
+	if (!CachedLocations.IsValidIndex(Boid.Id))
+	{
+		CachedLocations.SetNum(Boid.Id + 1);
+		CachedSendTimes.SetNum(Boid.Id + 1);
+	}
+	CachedLocations[Boid.Id] = QuantizeLocation(Boid.Location);
+	CachedSendTimes[Boid.Id] = GetWorld()->GetTimeSeconds();
 }
 
-void AMSBoidReplicator::RemoveBoid(const FMSBoid& Boid)
+void AMSBoidReplicator::RemoveBoid(const uint16 NetId)
 {
 	if (GetNetMode() == ENetMode::NM_Client) return;
 
-	this->Boids.Remove(Boid);
-	this->CachedBoidLocations.Remove(Boid.Id);
+	if (MulticastStream.Baselines.IsValidIndex(NetId)) MulticastStream.Baselines[NetId] = FMSBoidNetBaseline();
+	for (TPair<TWeakObjectPtr<AMSBoidPlayerController>, FMSBoidConnectionState>& Connection : Connections)
+	{
+		FMSBoidConnectionState& State = Connection.Value;
+		if (State.Stream.Baselines.IsValidIndex(NetId)) State.Stream.Baselines[NetId] = FMSBoidNetBaseline();
+		if (State.SentLocations.IsValidIndex(NetId)) State.SentLocations[NetId] = FIntVector(FMSBoidConnectionState::NotSent);
+	}
+
+	// Boids tend to go in groups, next frame sends the whole group's releases together
+	PendingReleases.Add(NetId);
+	if (!GetWorldTimerManager().TimerExists(SpawnStreamTimerHandle))
+	{
+		SpawnStreamTimerHandle = GetWorldTimerManager().SetTimerForNextTick(this, &AMSBoidReplicator::SendSpawnChunks);
+	}
+}
+
+void AMSBoidReplicator::NetCastReleaseBoids_Implementation(const TArray<uint16>& NetIds)
+{
+	if (GetNetMode() != ENetMode::NM_Client) return;
+
+	// Destroyed as one batch per archetype, the destroy observer then frees their slots and net ids like the server's
+	UMassEntitySubsystem* MassSubsystem = BoidSubsystem->MassEntitySubsystem;
+	TMap<FMassArchetypeHandle, TArray<FMassEntityHandle>> EntitiesByArchetype;
+	for (const uint16 NetId : NetIds)
+	{
+		// The next boid with the id deltas against its own keyframe, never against this one's
+		if (NetBaselines.IsValidIndex(NetId)) NetBaselines[NetId] = FMSBoidNetBaseline();
+
+		const FMassEntityHandle Entity = BoidSubsystem->GetBoidByNetId(NetId);
+		if (!Entity.IsSet() || !MassSubsystem->IsEntityValid(Entity)) continue;
+		EntitiesByArchetype.FindOrAdd(MassSubsystem->GetArchetypeForEntity(Entity)).Add(Entity);
+	}
+
+	for (const TPair<FMassArchetypeHandle, TArray<FMassEntityHandle>>& Entities : EntitiesByArchetype)
+	{
+		MassSubsystem->BatchDestroyEntityChunks(
+			FMassArchetypeSubChunks(Entities.Key, Entities.Value, FMassArchetypeSubChunks::NoDuplicates));
+	}
+}
+
+int32 AMSBoidReplicator::GetMaxBaselineAge() const
+{
+	// The sequence wraps, a baseline older than that many keyframes could match a newer one by accident
+	return (MSBoidNet::SequenceMask + 1) * NetKeyframeInterval * BatchesPerUpdate;
 }
 
 bool AMSBoidReplicator::IsUpdateValid()
@@ -180,32 +808,92 @@ bool AMSBoidReplicator::IsUpdateValid()
 	return false;
 }
 
-void AMSBoidReplicator::NetCastLocations_Implementation(const TArray<FMSBoidLocationNet>& BoidLocations,
+void AMSBoidReplicator::NetCastLocations_Implementation(const FMSBoidLocationBatchNet& BoidLocations,
                                                         int32 ServerStepNumber)
 {
 	if (GetNetMode() != ENetMode::NM_Client) return;
 
+	ApplyLocationBatch(BoidLocations, ServerStepNumber);
+}
+
+void AMSBoidReplicator::ApplyLocationBatch(const FMSBoidLocationBatchNet& BoidLocations, int32 ServerStepNumber)
+{
 	UE_LOG(LogTemp, Error, TEXT("ARTSBoidLocationReplicator. Client recieve update no. %d at time %f"), ServerStepNumber, UGameplayStatics::GetRealTimeSeconds(GetWorld()));
 
 	//if (!IsUpdateValid()) return;
+
+	RecordLocationBatch(BoidLocations);
+
+	const int32 MaxBaselineAge = GetMaxBaselineAge();
+
+	// The server sent this half a round trip ago, the boids have moved on since
+	const APlayerController* PlayerController = GetWorld()->GetFirstPlayerController();
+	const float Latency = PlayerController && PlayerController->PlayerState
+		                      ? PlayerController->PlayerState->ExactPing * 0.0005f
+		                      : 0.0f;
+
+	UMassEntitySubsystem* MassSubsystem = BoidSubsystem->MassEntitySubsystem;
+	FMSBoidStateBuffer& StateBuffer = BoidSubsystem->GetMutableReadStateBuffer();
 	
-	for (const auto& BoidLocation : BoidLocations)
+	for (const FMSBoidLocationNetEntry& BoidLocation : BoidLocations.Entries)
 	{
-		FMassEntityHandle* CurrentBoidHandle = BoidSubsystem->NetIdMassHandleMap.Find(BoidLocation.BoidId);
-		FVector CurrentLocation = BoidSubsystem->MassEntitySubsystem->GetFragmentDataChecked<FMSBoidLocationFragment>(*CurrentBoidHandle).Location;
-		FVector ServerLocation = FVector(
-			BoidLocation.LocationX * NetUpdatePrecisionTolerance,
-			BoidLocation.LocationY * NetUpdatePrecisionTolerance,
-			BoidLocation.LocationZ * NetUpdatePrecisionTolerance
-			);
+		const FMassEntityHandle CurrentBoidHandle = BoidSubsystem->GetBoidByNetId(BoidLocation.BoidId);
+		if (!CurrentBoidHandle.IsSet()) continue;
+
+		// Unreliable updates can come out of order, a late one would pull the boid back to where it was
+		FMSBoidNetCorrectionFragment& Correction =
+			MassSubsystem->GetFragmentDataChecked<FMSBoidNetCorrectionFragment>(CurrentBoidHandle);
+		if (ServerStepNumber <= Correction.LastServerStep) continue;
+		Correction.LastServerStep = ServerStepNumber;
+
+		if (!NetBaselines.IsValidIndex(BoidLocation.BoidId)) NetBaselines.SetNum(BoidLocation.BoidId + 1);
+		FMSBoidNetBaseline& Baseline = NetBaselines[BoidLocation.BoidId];
+
+		FIntVector QuantizedLocation = BoidLocation.Location;
+		if (BoidLocations.bAbsolute)
+		{
+			Baseline = {QuantizedLocation, BoidLocations.BaselineSequence, ServerStepNumber};
+		}
+		else
+		{
+			// The keyframe this delta refers to got lost, wait for the next one
+			if (Baseline.Sequence != BoidLocations.BaselineSequence ||
+				ServerStepNumber - Baseline.StepNumber >= MaxBaselineAge)
+			{
+				continue;
+			}
+			QuantizedLocation += Baseline.Location;
+		}
+
+		// Delta entries carry no velocity, the boid's own one is close enough to cover the latency
+		const int32 Slot = BoidSubsystem->GetBoidSlot(CurrentBoidHandle);
+		FVector& CurrentLocation = StateBuffer.Locations[Slot];
+		const FVector& Velocity = BoidLocations.bAbsolute ? BoidLocation.Velocity : StateBuffer.Velocities[Slot];
+		const FVector ServerLocation = FVector(QuantizedLocation) * NetUpdatePrecisionTolerance + Velocity * Latency;
 
 		UE_LOG(LogTemp, Error, TEXT("ARTSBoidLocationReplicator. Id: %d ServerLocation: %s, ClientLocation: %s"), BoidLocation.BoidId, *ServerLocation.ToString(), *CurrentLocation.ToString());
-		
-		if (!CurrentLocation.Equals(ServerLocation, NetUpdatePrecisionTolerance))
+
+		// Where the boid ends up once the correction in progress is through
+		const FVector CorrectedLocation = CurrentLocation + Correction.RemainingError;
+		CorrectionErrorSum += FVector::Dist(CorrectedLocation, ServerLocation);
+		++CorrectionErrorCount;
+		if (CorrectedLocation.Equals(ServerLocation, NetUpdatePrecisionTolerance)) continue;
+
+		if (BoidLocations.bAbsolute) StateBuffer.Velocities[Slot] = BoidLocation.Velocity;
+
+		const FVector Error = ServerLocation - CurrentLocation;
+		if (!bSmoothNetCorrections || NetCorrectionBlendTime <= 0.0f ||
+			Error.SizeSquared() > FMath::Square(NetCorrectionSnapDistance))
+		{
+			CurrentLocation = ServerLocation;
+			Correction.RemainingError = FVector::ZeroVector;
+			Correction.RemainingTime = 0.0f;
+		}
+		else
 		{
-			// BoidLocation.Boid->ApplyServerLocationUpdate(ServerLocation);
-			BoidSubsystem->MassEntitySubsystem->GetFragmentDataChecked<FMSBoidLocationFragment>(*CurrentBoidHandle).Location = ServerLocation;
-			BoidSubsystem->MassEntitySubsystem->GetFragmentDataChecked<FMSBoidVelocityFragment>(*CurrentBoidHandle).Velocity = BoidLocation.Velocity;
+			// The server location becomes the target, UMSBoidNetCorrectionProcessor walks the boid there
+			Correction.RemainingError = Error;
+			Correction.RemainingTime = NetCorrectionBlendTime;
 		}
 	}
 }
@@ -4,72 +4,138 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
+#include "MSBoidHashGrid.h"
 #include "MSBoidReplicator.generated.h"
 
+class AMSBoidPlayerController;
 class UMSBoidSubsystem;
 struct FMSBoid;
 
+/** One boid of a location batch, quantized by NetUpdatePrecisionTolerance */
+struct FMSBoidLocationNetEntry
+{
+	uint16 BoidId = 0;
+
+	/** Absolute in absolute batches, otherwise the offset from the boid's baseline */
+	FIntVector Location = FIntVector::ZeroValue;
+
+	/** Only sent in absolute batches, zero in delta ones */
+	FVector Velocity = FVector::ZeroVector;
+};
+
+/**
+ * Location update of a set of boids, bit packed by NetSerialize:
+ * - Ids are sorted and sent as runs of consecutive ids.
+ * - Locations are zigzag encoded with the fewest bits per axis that fit every entry of the batch.
+ * - Velocities are a quantized speed plus the two smallest components of their direction, in absolute batches only.
+ * The packed payload goes out behind its length in bits, so both ends know the batch's size without packing it again.
+ */
 USTRUCT()
-struct FMSBoidLocationNet
+struct FMSBoidLocationBatchNet
 {
 	GENERATED_BODY()
 
-	UPROPERTY()
-	int16 LocationX;
-	UPROPERTY()
-	int16 LocationY;
-	UPROPERTY()
-	int16 LocationZ;
-	UPROPERTY()
-	uint16 BoidId;
+	/** Locations are absolute and become the boids' new baselines, otherwise they are deltas against them */
+	bool bAbsolute = true;
 
-	UPROPERTY()
-	FVector_NetQuantize Velocity;
+	/** Keyframe the baselines come from, wraps at 8 */
+	uint8 BaselineSequence = 0;
 
-	FMSBoidLocationNet()
-	{
-		LocationX = 0;
-		LocationY = 0;
-		LocationZ = 0;
-		BoidId = 0;
-		Velocity = FVector::ZeroVector;
-	}
+	/** Velocities are quantized up to this speed */
+	float MaxSpeed = 0.0f;
+
+	/** Sorted by id, no duplicates */
+	TArray<FMSBoidLocationNetEntry> Entries;
+
+	/** Size of the packed payload, set by Pack on the sending side and by NetSerialize on the receiving side */
+	int64 NumSerializedBits = 0;
+
+	/** Packs the entries once, every connection the batch goes to then gets a copy of the same bits */
+	void Pack();
+
+	/** Drops the entries and the packed payload, ready for the next batch */
+	void Reset();
+
+	bool NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess);
 
-	FMSBoidLocationNet(uint16 LocationX, uint16 LocationY, uint16 LocationZ, uint16 BoidId, FVector Velocity)
+private:
+	/** Reads or writes the bit packed batch itself */
+	bool SerializePayload(FArchive& Ar);
+
+	/** Output of Pack, only on the sending side */
+	TArray<uint8> PackedPayload;
+};
+
+template<>
+struct TStructOpsTypeTraits<FMSBoidLocationBatchNet> : public TStructOpsTypeTraitsBase2<FMSBoidLocationBatchNet>
+{
+	enum
 	{
-		this->LocationX = LocationX;
-		this->LocationY = LocationY;
-		this->LocationZ = LocationZ;
-		this->BoidId = BoidId;
-		this->Velocity = Velocity;
-	}
+		WithNetSerializer = true
+	};
 };
 
-USTRUCT()
-struct FMSBoidCachedLocation
+/** Quantized location a boid's deltas are taken against, and the keyframe it was sent in */
+struct FMSBoidNetBaseline
 {
-	GENERATED_BODY()
+	/** Never matches a real sequence, which only has 3 bits */
+	static constexpr uint8 NoSequence = 0xFF;
 
-	UPROPERTY()
-	float LocationX;
-	UPROPERTY()
-	float LocationY;
-	UPROPERTY()
-	float LocationZ;
+	FIntVector Location = FIntVector::ZeroValue;
+	uint8 Sequence = NoSequence;
+	int32 StepNumber = 0;
+};
 
-	FMSBoidCachedLocation()
-	{
-		LocationX = 0;
-		LocationY = 0;
-		LocationZ = 0;
-	}
+/** Baselines and pending batches of one stream of location updates, the multicast one or a single client's */
+struct FMSBoidLocationStream
+{
+	/** Indexed by net id */
+	TArray<FMSBoidNetBaseline> Baselines;
 
-	FMSBoidCachedLocation(float LocationX, float LocationY, float LocationZ)
+	/** Boids sent this batch, split by whether they can be delta encoded */
+	FMSBoidLocationBatchNet AbsoluteBatch;
+	FMSBoidLocationBatchNet DeltaBatch;
+
+	FMSBoidLocationStream()
 	{
-		this->LocationX = LocationX;
-		this->LocationY = LocationY;
-		this->LocationZ = LocationZ;
+		AbsoluteBatch.bAbsolute = true;
+		DeltaBatch.bAbsolute = false;
 	}
+
+	/**
+	 * Queues the boid absolute when it has no baseline from the current keyframe, or one clients would already reject
+	 * as older than MaxBaselineAge steps, which makes this its baseline
+	 */
+	void Add(uint16 BoidId, const FIntVector& QuantizedLocation, const FVector& Velocity, bool bKeyframe,
+	         uint8 KeyframeSequence, int32 StepNumber, int32 MaxBaselineAge);
+};
+
+/** Boid whose location changed at wire precision since the multicast last sent it */
+struct FMSBoidNetDirtyEntry
+{
+	uint16 BoidId;
+	/** Error since the last send in cm, plus the time since it weighted by NetPriorityTimeWeight */
+	float Priority;
+	FIntVector QuantizedLocation;
+	FVector Velocity;
+};
+
+/** Server side state of one client getting its own relevancy filtered stream */
+struct FMSBoidConnectionState
+{
+	FMSBoidLocationStream Stream;
+
+	/** Never a real quantized location */
+	static constexpr int32 NotSent = MAX_int32;
+
+	/**
+	 * Last quantized location sent to this client by net id, boids that haven't moved since are skipped.
+	 * Sends are unreliable, so this is only what was sent: keyframes resend every relevant boid regardless.
+	 */
+	TArray<FIntVector> SentLocations;
+
+	/** Measured from the batches sent so far, turns the byte budget into a number of boids */
+	float BytesPerBoid = 8.0f;
 };
 
 USTRUCT()
@@ -109,11 +175,26 @@ public:
 
 	/** All clients-side. Apply server's Boid location */
 	UFUNCTION(NetMulticast, Unreliable)
-	void NetCastLocations(const TArray<FMSBoidLocationNet>& BoidLocations, int32 ServerStepNumber);
+	void NetCastLocations(const FMSBoidLocationBatchNet& BoidLocations, int32 ServerStepNumber);
 
+	/** One chunk of a spawn stream, spawned on the server too */
 	UFUNCTION(NetMulticast, Reliable)
 	void NetCastSpawnBoids(const TArray<FMSBoidNetSpawnData>& BoidData);
 
+	/** Server side. Streams the boids to everybody in NetSpawnChunkSize chunks over the next frames */
+	void QueueSpawn(const TArray<FMSBoidNetSpawnData>& BoidData);
+
+	/** Server side. Streams every boid the client missed by joining late, with their current state */
+	void QueueJoinSpawn(AMSBoidPlayerController* PlayerController);
+
+	/** Lockstep spawn, every peer generates the boids from the seed itself before the given lockstep step */
+	UFUNCTION(NetMulticast, Reliable)
+	void NetCastSpawnBoidsFromSeed(int32 Seed, int32 FirstNetId, int32 Count, int32 LockstepStep);
+
+	/** Lockstep. Server's state checksum after the step, clients check theirs against it */
+	UFUNCTION(NetMulticast, Unreliable)
+	void NetCastStepChecksum(int32 LockstepStep, uint32 Checksum);
+
 	UFUNCTION()
 	void StartUpdates();
 
@@ -122,16 +203,49 @@ public:
 
 	void AddBoid(const FMSBoid& Boid);
 
-	void RemoveBoid(const FMSBoid& Boid);
+	/**
+	 * Server side. Forgets the boid's replication state and queues its release to the clients, the id is only recycled
+	 * once that went out so a later boid getting it starts clean everywhere
+	 */
+	void RemoveBoid(uint16 NetId);
+
+	/** Chunk of destroyed boids' net ids. Reliable on the same channel as spawns, so it lands before any reuse */
+	UFUNCTION(NetMulticast, Reliable)
+	void NetCastReleaseBoids(const TArray<uint16>& NetIds);
 
 	/** Checks update timings to see if it was not in time and therefore has outdated positions */
 	UFUNCTION()
 	bool IsUpdateValid();
 
-	TArray<FMSBoid> Boids;
+	/** Average size of a boid in the last BatchesPerUpdate location batches sent or received, in bytes */
+	float GetBytesPerBoid() const { return BytesPerBoid; }
+
+	/** Server side. Quantized location the multicast last sent of every boid by net id, and when it did */
+	TArray<FIntVector> CachedLocations;
+	TArray<float> CachedSendTimes;
+
+	/** Load test readings, AMSBoidLoadTestRecorder takes and resets them once per row */
+	double ReplicationSeconds = 0.0;
+	double CorrectionErrorSum = 0.0;
+	int32 CorrectionErrorCount = 0;
+
+	/** Server side. Boids that moved since their last send, rebuilt every frame by UMSBoidNetDirtyProcessor */
+	TArray<FMSBoidNetDirtyEntry> DirtyBoids;
+
+	/** Groups DirtyBoids by blocks of net ids so each batch only reads the entries of its own slice */
+	void BucketDirtyBoids();
+	void ResetDirtyBoids();
+
+	FIntVector QuantizeLocation(const FVector& Location) const;
 
-	/** Stores past boid Locations to check if they have changed */
-	TMap<uint16, FMSBoidCachedLocation> CachedBoidLocations;
+	/** Steps after which a baseline is too old to delta against, both ends apply the same limit */
+	int32 GetMaxBaselineAge() const;
+
+	/** Client side. Baseline of every boid by net id, what the deltas received are decoded with */
+	TArray<FMSBoidNetBaseline> NetBaselines;
+
+	/** Client side. Decodes a batch received through the multicast or the player controller and applies it */
+	void ApplyLocationBatch(const FMSBoidLocationBatchNet& BoidLocations, int32 ServerStepNumber);
 
 	/** How many times we divide the Boid array based on the LocationUpdateFrequency */
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Net Testing", meta = (ClampMin = 0))
@@ -149,17 +263,141 @@ public:
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Net Testing", meta = (ClampMin = 0))
 	float NetUpdateTimeThreshold = 0.03f;
 
+	/** Every how many full updates the boids are sent as absolute locations, which become the new delta baselines */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Net Testing", meta = (ClampMin = 1))
+	uint8 NetKeyframeInterval = 8;
+
+	/** Clients blend server corrections in over NetCorrectionBlendTime instead of snapping to them */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Net Testing")
+	bool bSmoothNetCorrections = true;
+
+	/** Seconds a client takes to absorb a server correction */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Net Testing", meta = (ClampMin = 0))
+	float NetCorrectionBlendTime = 0.5f;
+
+	/** Corrections larger than this snap right away */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Net Testing", meta = (ClampMin = 0))
+	float NetCorrectionSnapDistance = 1000.0f;
+
+	/** Send every client its own stream of the boids around its view through its player controller, instead of multicasting */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Net Testing")
+	bool bPerConnectionRelevancy = false;
+
+	/** Boids closer than this to a client's view are sent with every batch instead of once per full update */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Net Testing", meta = (ClampMin = 0))
+	float NetRelevancyNearDistance = 10000.0f;
+
+	/** Boids further than this from a client's view are not sent to it at all */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Net Testing", meta = (ClampMin = 0))
+	float NetRelevancyFarDistance = 30000.0f;
+
+	/** Full updates between two sends of a boid that is neither near nor far */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Net Testing", meta = (ClampMin = 1))
+	int32 NetRelevancyMediumPeriod = 4;
+
+	/** Bytes of boid locations each client may be sent per batch, the closest boids go first */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Net Testing", meta = (ClampMin = 1))
+	int32 NetBytesBudgetPerBatch = 1024;
+
+	/** Bytes of boid locations the multicast may send per batch, highest priority first. 0 sends every changed boid */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Net Testing", meta = (ClampMin = 0))
+	int32 NetMulticastBytesBudgetPerBatch = 0;
+
+	/** Priority a changed boid gains per second it waits, in cm of error */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Net Testing", meta = (ClampMin = 0))
+	float NetPriorityTimeWeight = 10.0f;
+
+	/** Boids per spawn RPC */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Net Testing", meta = (ClampMin = 1))
+	int32 NetSpawnChunkSize = 512;
+
+	/** Spawn RPCs each client may be sent per frame */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Net Testing", meta = (ClampMin = 1))
+	int32 NetSpawnChunksPerFrame = 4;
+
 	UPROPERTY()
 	UMSBoidSubsystem* BoidSubsystem;
 
-	UPROPERTY()
-	TArray<FMSBoidLocationNet> BoidsToUpdate;
+	/** Server side. Stream everybody gets when not filtering per connection */
+	FMSBoidLocationStream MulticastStream;
+
+	/** Server side. One entry per remote client, only used with bPerConnectionRelevancy */
+	TMap<TWeakObjectPtr<AMSBoidPlayerController>, FMSBoidConnectionState> Connections;
 
 	uint8 CurrentBatchIndex = 0;
-	int CurrentBoidIndex = 0;
-	uint16 BoidsPerBatch = 0;
 	float LastUpdateTime = 0;
 	FTimerHandle UpdateTimerHandle;
 	UPROPERTY()
 	int32 StepNumber = 0;
+
+	/** Full updates sent so far, every NetKeyframeInterval-th one is a keyframe */
+	uint32 UpdateCycle = 0;
+
+private:
+	/** Boid picked for a client's stream, with everything the stream needs to send it */
+	struct FRelevantBoid
+	{
+		uint16 BoidId;
+		FVector Location;
+		FVector Velocity;
+		FIntVector QuantizedLocation;
+	};
+
+	/** Picks the changed boids of the current batch from the dirty list and adds them to the multicast stream */
+	void ReplicateDirtyBoids(int32 SliceBegin, int32 SliceEnd, bool bKeyframe, uint8 KeyframeSequence);
+
+	/**
+	 * Picks the boids around the client's view from the relevancy grid and sends them, closest first within the
+	 * budget. Near boids go with every batch, the others when the batch's slice of ids comes around.
+	 */
+	void ReplicateToConnection(AMSBoidPlayerController* PlayerController, FMSBoidConnectionState& Connection,
+	                           uint32 Cycle, bool bKeyframe, uint8 KeyframeSequence, int32 SliceBegin, int32 SliceEnd);
+
+	/** Sends to the player controller's client, or to everybody without one. Returns the size of the batch in bits */
+	int64 SendLocationBatch(FMSBoidLocationBatchNet& Batch, AMSBoidPlayerController* PlayerController = nullptr);
+
+	int64 RecordLocationBatch(const FMSBoidLocationBatchNet& Batch);
+
+	/** Server side. Every boid in cells of NetRelevancyNearDistance, rebuilt once per batch and queried per client */
+	FMSBoidHashGrid RelevancyGrid;
+
+	/** Server side. Spawns the multicast hasn't sent yet, from NumSent on */
+	struct FSpawnStream
+	{
+		TArray<FMSBoidNetSpawnData> Pending;
+		int32 NumSent = 0;
+	};
+
+	/** Server side. Net ids a late joiner still has to get, the boids' state is read when their chunk goes out */
+	struct FJoinSpawnStream
+	{
+		int32 NextNetId = 0;
+		int32 EndNetId = 0;
+	};
+
+	/**
+	 * Sends the pending releases and this frame's share of the spawn streams, and comes back next frame while any has
+	 * something left
+	 */
+	void SendSpawnChunks();
+
+	FSpawnStream MulticastSpawnStream;
+	/** Server side. Net ids released since the last chunk of releases went out */
+	TArray<uint16> PendingReleases;
+	TMap<TWeakObjectPtr<AMSBoidPlayerController>, FJoinSpawnStream> JoinSpawnStreams;
+	FTimerHandle SpawnStreamTimerHandle;
+
+	TArray<FRelevantBoid> CandidateBoids;
+	TArray<TPair<float, int32>> RelevantBoids;
+
+	/** Net ids per DirtyBoids bucket, as a shift */
+	static constexpr int32 DirtyBlockBits = 8;
+	/** First DirtyBoids entry of every block of net ids, plus the end */
+	TArray<int32> DirtyBlockStarts;
+	TArray<FMSBoidNetDirtyEntry> BucketedDirtyBoids;
+
+	int64 RecordedBits = 0;
+	int32 RecordedBoids = 0;
+	int32 RecordedBatches = 0;
+	float BytesPerBoid = 0.0f;
 };
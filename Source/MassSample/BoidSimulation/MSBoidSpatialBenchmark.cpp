@@ -0,0 +1,162 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MSBoidHashGrid.h"
+#include "MSBoidLinearOctree.h"
+#include "MSBoidOctree.h"
+#include "HAL/IConsoleManager.h"
+
+namespace UE::MSBoidSpatialBenchmark
+{
+	/** Same default as the subsystem's sight radius */
+	static constexpr float QueryRadius = 100.0f;
+
+	/** Boids per cubic query radius, kept the same at every size so only the population changes between runs */
+	static constexpr double BoidsPerCubicRadius = 0.02;
+
+	/** Queries timed per run, enough to average out without the 500k run taking minutes */
+	static constexpr int32 MaxQueries = 20000;
+
+	struct FResult
+	{
+		double BuildMs = 0.0;
+		double QueryMs = 0.0;
+		int64 NeighborsFound = 0;
+	};
+
+	template<typename BuildFunctionType, typename QueryFunctionType>
+	static FResult Measure(const TArray<FVector>& QueryCenters, const BuildFunctionType& Build,
+	                       const QueryFunctionType& Query)
+	{
+		FResult Result;
+
+		double StartTime = FPlatformTime::Seconds();
+		Build();
+		Result.BuildMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+
+		StartTime = FPlatformTime::Seconds();
+		for (const FVector& Center : QueryCenters)
+		{
+			Result.NeighborsFound += Query(Center);
+		}
+		Result.QueryMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+
+		return Result;
+	}
+
+	static void LogResult(const TCHAR* Backend, const int32 NumBoids, const int32 NumQueries, const FResult& Result)
+	{
+		UE_LOG(LogTemp, Log, TEXT("Boid spatial benchmark: %-13s %7d boids, build %8.2f ms, %d queries %8.2f ms, %lld neighbors"),
+		       Backend, NumBoids, Result.BuildMs, NumQueries, Result.QueryMs, Result.NeighborsFound);
+	}
+
+	static void Run(const int32 NumBoids)
+	{
+		// Same seed every run, so the three backends and repeated runs all see the same boids
+		FRandomStream RandomStream(NumBoids);
+
+		const double Volume = NumBoids / BoidsPerCubicRadius * QueryRadius * QueryRadius * QueryRadius;
+		const float Extent = 0.5f * (float)FMath::Pow(Volume, 1.0 / 3.0);
+
+		TArray<FMassEntityHandle> Entities;
+		TArray<FVector> Locations;
+		TArray<FVector> Velocities;
+		Entities.SetNum(NumBoids);
+		Locations.SetNumUninitialized(NumBoids);
+		Velocities.SetNumUninitialized(NumBoids);
+		for (int32 i = 0; i < NumBoids; ++i)
+		{
+			Entities[i] = FMassEntityHandle(i, 1);
+			Locations[i] = FVector(RandomStream.FRandRange(-Extent, Extent), RandomStream.FRandRange(-Extent, Extent),
+			                       RandomStream.FRandRange(-Extent, Extent));
+			Velocities[i] = RandomStream.VRand() * 100.0f;
+		}
+
+		const int32 NumQueries = FMath::Min(NumBoids, MaxQueries);
+		TArray<FVector> QueryCenters;
+		QueryCenters.Reserve(NumQueries);
+		for (int32 i = 0; i < NumQueries; ++i)
+		{
+			QueryCenters.Add(Locations[RandomStream.RandHelper(NumBoids)]);
+		}
+
+		const float RadiusSquared = QueryRadius * QueryRadius;
+
+		{
+			FMSBoidOctree Octree(FVector::ZeroVector, Extent);
+			LogResult(TEXT("Octree"), NumBoids, NumQueries, Measure(QueryCenters, [&]()
+			{
+				for (int32 i = 0; i < NumBoids; ++i)
+				{
+					Octree.AddElement(FMSBoid(Locations[i], Velocities[i], 0));
+				}
+			}, [&](const FVector& Center)
+			{
+				int32 NumFound = 0;
+				Octree.FindElementsWithBoundsTest(FBoxCenterAndExtent(Center, FVector(QueryRadius)), [&](const FMSBoid& Boid)
+				{
+					NumFound += FVector::DistSquared(Center, Boid.Location) < RadiusSquared;
+				});
+				return NumFound;
+			}));
+		}
+
+		{
+			FMSBoidHashGrid HashGrid;
+			LogResult(TEXT("HashGrid"), NumBoids, NumQueries, Measure(QueryCenters, [&]()
+			{
+				HashGrid.Build(Entities, Locations, Velocities, QueryRadius);
+			}, [&](const FVector& Center)
+			{
+				int32 NumFound = 0;
+				HashGrid.ForEachBoidInRadius(Center, QueryRadius, [&NumFound](const FVector&, const FVector&)
+				{
+					++NumFound;
+				});
+				return NumFound;
+			}));
+		}
+
+		{
+			FMSBoidLinearOctree LinearOctree;
+			LogResult(TEXT("LinearOctree"), NumBoids, NumQueries, Measure(QueryCenters, [&]()
+			{
+				LinearOctree.Build(Locations, Velocities, QueryRadius);
+			}, [&](const FVector& Center)
+			{
+				int32 NumFound = 0;
+				LinearOctree.ForEachBoidInRadius(Center, QueryRadius, [&NumFound](const FVector&, const FVector&)
+				{
+					++NumFound;
+				});
+				return NumFound;
+			}));
+		}
+	}
+}
+
+static FAutoConsoleCommand CompareSpatialBackendsCommand(
+	TEXT("boids.CompareSpatialBackends"),
+	TEXT("Builds and queries all three boid spatial backends on the same synthetic boids and logs the timings. ")
+	TEXT("Takes the boid counts to run, defaults to 20000 100000 500000."),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		TArray<int32> BoidCounts;
+		for (const FString& Arg : Args)
+		{
+			const int32 NumBoids = FCString::Atoi(*Arg);
+			if (NumBoids > 0)
+			{
+				BoidCounts.Add(NumBoids);
+			}
+		}
+		if (BoidCounts.Num() == 0)
+		{
+			BoidCounts = {20000, 100000, 500000};
+		}
+
+		for (const int32 NumBoids : BoidCounts)
+		{
+			UE::MSBoidSpatialBenchmark::Run(NumBoids);
+		}
+	})
+);
@@ -8,10 +8,13 @@
 #include "MSBoidDevSettings.h"
 #include "MSBoidFragments.h"
 #include "MSBoidHismHelper.h"
+#include "MSBoidLoadTestRecorder.h"
 #include "MSBoidNiagaraHelper.h"
-#include "Common/Misc/MSBPFunctionLibrary.h"
+#include "MSBoidPlayerController.h"
+#include "Async/ParallelFor.h"
 #include "Components/HierarchicalInstancedStaticMeshComponent.h"
 #include "GameFramework/GameStateBase.h"
+#include "GameFramework/PlayerState.h"
 
 void UMSBoidSubsystem::Initialize(FSubsystemCollectionBase& Collection)
 {
@@ -24,6 +27,16 @@ void UMSBoidSubsystem::Initialize(FSubsystemCollectionBase& Collection)
 	NumOfBoids = BoidSettings->NumOfBoids;
 	bDrawDebugBoxes = BoidSettings->DrawDebugBoxes;
 	bIsStatic = BoidSettings->Static;
+	SpatialBackend = BoidSettings->SpatialBackend;
+	bLockstep = BoidSettings->bLockstepSimulation;
+	LockstepChecksumInterval = FMath::Max(BoidSettings->LockstepChecksumInterval, 1);
+	LockstepSpawnLeadSteps = FMath::Max(BoidSettings->LockstepSpawnLeadSteps, 0);
+	LockstepDesyncReportCooldown = FMath::Max(BoidSettings->LockstepDesyncReportCooldown, 0.0f);
+	// Lockstep only holds with every peer integrating the exact same step length
+	bFixedStepSimulation = BoidSettings->bFixedStepSimulation || bLockstep;
+	// ClampMin only guards the editor, a hand edited ini can still hold 0 or less
+	FixedStepTime = 1.0f / FMath::Max(BoidSettings->FixedStepHz, 1.0f);
+	MaxStepsPerFrame = FMath::Max(BoidSettings->MaxStepsPerFrame, 1);
 
 	BoidReplicator = (AMSBoidReplicator*)GetWorld()->SpawnActor(AMSBoidReplicator::StaticClass());
 	BoidReplicator->BoidSubsystem = this;
@@ -31,6 +44,19 @@ void UMSBoidSubsystem::Initialize(FSubsystemCollectionBase& Collection)
 	BoidReplicator->LocationUpdateFrequency = BoidSettings->LocationUpdateFrequency;
 	BoidReplicator->NetUpdatePrecisionTolerance = BoidSettings->NetUpdatePrecisionTolerance;
 	BoidReplicator->NetUpdateTimeThreshold = BoidSettings->NetUpdateTimeThreshold;
+	BoidReplicator->NetKeyframeInterval = FMath::Max<uint8>(BoidSettings->NetKeyframeInterval, 1);
+	BoidReplicator->bSmoothNetCorrections = BoidSettings->bSmoothNetCorrections;
+	BoidReplicator->NetCorrectionBlendTime = BoidSettings->NetCorrectionBlendTime;
+	BoidReplicator->NetCorrectionSnapDistance = BoidSettings->NetCorrectionSnapDistance;
+	BoidReplicator->bPerConnectionRelevancy = BoidSettings->bPerConnectionRelevancy;
+	BoidReplicator->NetRelevancyNearDistance = BoidSettings->NetRelevancyNearDistance;
+	BoidReplicator->NetRelevancyFarDistance = BoidSettings->NetRelevancyFarDistance;
+	BoidReplicator->NetRelevancyMediumPeriod = FMath::Max(BoidSettings->NetRelevancyMediumPeriod, 1);
+	BoidReplicator->NetBytesBudgetPerBatch = FMath::Max(BoidSettings->NetBytesBudgetPerBatch, 1);
+	BoidReplicator->NetMulticastBytesBudgetPerBatch = FMath::Max(BoidSettings->NetMulticastBytesBudgetPerBatch, 0);
+	BoidReplicator->NetPriorityTimeWeight = BoidSettings->NetPriorityTimeWeight;
+	BoidReplicator->NetSpawnChunkSize = FMath::Max(BoidSettings->NetSpawnChunkSize, 1);
+	BoidReplicator->NetSpawnChunksPerFrame = FMath::Max(BoidSettings->NetSpawnChunksPerFrame, 1);
 
 
 	BoidOctree = MakeUnique<FMSBoidOctree>(FVector::ZeroVector, SimulationExtentFromCenter);
@@ -38,9 +64,30 @@ void UMSBoidSubsystem::Initialize(FSubsystemCollectionBase& Collection)
 	GetWorld()->SpawnActor<AMSBoidHismHelper>(AMSBoidHismHelper::StaticClass());
 	GetWorld()->SpawnActor<AMSBoidNiagaraHelper>(BoidSettings->NiagaraActorClass);
 
+	if (FParse::Param(FCommandLine::Get(), TEXT("BoidLoadTest")))
+	{
+		GetWorld()->SpawnActor<AMSBoidLoadTestRecorder>(AMSBoidLoadTestRecorder::StaticClass());
+	}
+
 	MassEntitySubsystem = GetWorld()->GetSubsystem<UMassEntitySubsystem>();
 
 	Context = MassEntitySubsystem->CreateExecutionContext(0);
+
+	SpawnQuery.AddRequirement<FMSBoidRenderFragment>(EMassFragmentAccess::ReadWrite);
+	SpawnQuery.AddRequirement<FMSBoidNetId>(EMassFragmentAccess::ReadWrite);
+	SpawnQuery.AddRequirement<FMSBoidSlotFragment>(EMassFragmentAccess::ReadWrite);
+
+	if (bLockstep)
+	{
+		WorldTickStartHandle = FWorldDelegates::OnWorldTickStart.AddUObject(this, &UMSBoidSubsystem::SpawnDueSeedSpawns);
+	}
+}
+
+void UMSBoidSubsystem::Deinitialize()
+{
+	FWorldDelegates::OnWorldTickStart.Remove(WorldTickStartHandle);
+
+	Super::Deinitialize();
 }
 
 void UMSBoidSubsystem::OnWorldBeginPlay(UWorld& InWorld)
@@ -64,12 +111,10 @@ TArray<FMSBoid> UMSBoidSubsystem::GetBoidsInRadius(const FBoxCenterAndExtent& Qu
 TArray<FMassEntityHandle> UMSBoidSubsystem::GetBoidsInRadius(FVector Center, float Radius)
 {
 	TArray<FMassEntityHandle> FoundBoids;
-	HashGrid.FindPointsInBall(Center, Radius, [&, Center](const FMassEntityHandle& Entity)
+	HashGrid.ForEachEntryInRadius(Center, Radius, [&FoundBoids](const FMSBoidHashGridEntry& Entry)
 	{
-		const FVector EntityLocation = MassEntitySubsystem->GetFragmentDataChecked<FMSBoidLocationFragment>(Entity).
-		                                                    Location;
-		return UE::Geometry::DistanceSquared(Center, EntityLocation);
-	}, FoundBoids);
+		FoundBoids.Add(Entry.Entity);
+	});
 
 	return FoundBoids;
 }
@@ -138,79 +183,499 @@ void UMSBoidSubsystem::SpawnRandomBoids()
 	// the random data is only generated on the server to be later multicasted to clients
 	if (GetWorld()->GetNetMode() == ENetMode::NM_Client) return;
 
+	if (bLockstep)
+	{
+		// Only the seed goes over the net, every peer generates the same boids from it. The ids have to be a
+		// contiguous range for that, so the free list is left alone
+		if (NextNetId + NumOfBoids > MAX_uint16 + 1)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("UMSBoidSubsystem::SpawnRandomBoids() out of net ids for %d boids"), NumOfBoids);
+			return;
+		}
+
+		FMSBoidSeedSpawn SeedSpawn;
+		SeedSpawn.Seed = FMath::Rand();
+		SeedSpawn.FirstNetId = NextNetId;
+		SeedSpawn.Count = NumOfBoids;
+		// The first seed spawn lines the peers' steps up and can't be late, later ones have to reach every client first
+		SeedSpawn.LockstepStep = bLockstepStarted ? GetLockstepStep() + GetSeedSpawnLeadSteps() : 0;
+		NextNetId += NumOfBoids;
+
+		BoidReplicator->NetCastSpawnBoidsFromSeed(SeedSpawn.Seed, SeedSpawn.FirstNetId, SeedSpawn.Count,
+		                                          SeedSpawn.LockstepStep);
+		return;
+	}
+
 	TArray<FMSBoidNetSpawnData> SpawnData;
 
 	for (int i = 0; i < NumOfBoids; ++i)
 	{
-		SpawnData.Push(GenerateBoidRandomData());
+		uint16 NetId;
+		if (!AllocateNetId(NetId))
+		{
+			UE_LOG(LogTemp, Warning, TEXT("UMSBoidSubsystem::SpawnRandomBoids() out of net ids, spawned %d of %d"), i,
+			       NumOfBoids);
+			break;
+		}
+		SpawnData.Push(GenerateBoidRandomData(NetId));
 	}
 
-	BoidReplicator->NetCastSpawnBoids(SpawnData);
+	BoidReplicator->QueueSpawn(SpawnData);
 }
 
-FMSBoidNetSpawnData UMSBoidSubsystem::GenerateBoidRandomData()
+FMSBoidNetSpawnData UMSBoidSubsystem::GenerateBoidRandomData(const uint16 NetId)
 {
-	NextBoidId++;
 	return FMSBoidNetSpawnData(
-		NextBoidId,
+		NetId,
 		FMath::VRand() * FMath::RandRange(10, SimulationExtentFromCenter / 2),
 		FMath::VRand() * FMath::RandRange(10, BoidMaxSpeed)
 	);
 }
 
-void UMSBoidSubsystem::SpawnBoidsFromData(const TArray<FMSBoidNetSpawnData>& NewBoidData)
+FMSBoidNetSpawnData UMSBoidSubsystem::GenerateBoidRandomData(const uint16 NetId, FRandomStream& RandomStream) const
+{
+	// Two statements, argument evaluation order is up to the compiler and it has to match on every peer
+	const FVector Location = RandomStream.VRand() * RandomStream.RandRange(10, SimulationExtentFromCenter / 2);
+	const FVector Velocity = RandomStream.VRand() * RandomStream.RandRange(10, BoidMaxSpeed);
+	return FMSBoidNetSpawnData(NetId, Location, Velocity);
+}
+
+int32 UMSBoidSubsystem::GetSeedSpawnLeadSteps() const
 {
-	if (GetWorld()->GetNetMode() == ENetMode::NM_Client)
+	// The worst ping covers the multicast's trip to the slowest client with room to spare
+	float MaxPingSeconds = 0.0f;
+	for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; ++It)
 	{
-		UE_LOG(LogTemp, Warning, TEXT("UMSBoidSubsystem::SpawnBoidsFromData() in client num: %d"), NewBoidData.Num());
+		const APlayerController* PlayerController = It->Get();
+		if (!PlayerController || PlayerController->IsLocalController()) continue;
+		if (const APlayerState* PlayerState = PlayerController->GetPlayerState<APlayerState>())
+		{
+			MaxPingSeconds = FMath::Max(MaxPingSeconds, PlayerState->ExactPing * 0.001f);
+		}
+	}
+
+	return LockstepSpawnLeadSteps + FMath::CeilToInt(MaxPingSeconds / FixedStepTime);
+}
+
+bool UMSBoidSubsystem::IsValidDesyncReport(const int32 LockstepStep) const
+{
+	// Clients run behind the server, a report can't name a step the server hasn't reached or one before the start
+	return bLockstep && bLockstepStarted && LockstepStep >= 0 && LockstepStep <= GetLockstepStep();
+}
+
+void UMSBoidSubsystem::SpawnBoidsFromSeed(const FMSBoidSeedSpawn& SeedSpawn)
+{
+	if (!bLockstepStarted)
+	{
+		// The first seed spawn lines up the steps, every peer takes the step it spawns on as the server's step
+		LockstepOrigin = (int32)SimulationStep - SeedSpawn.LockstepStep;
+		bLockstepStarted = true;
+	}
+
+	if (GetLockstepStep() < SeedSpawn.LockstepStep)
+	{
+		PendingSeedSpawns.Add(SeedSpawn);
+		PendingSeedSpawns.StableSort([](const FMSBoidSeedSpawn& A, const FMSBoidSeedSpawn& B)
+		{
+			return A.LockstepStep < B.LockstepStep;
+		});
+		return;
+	}
+
+	if (GetLockstepStep() > SeedSpawn.LockstepStep && !bLockstepDesynced)
+	{
+		ReportLockstepDesync(SeedSpawn.LockstepStep, FString::Printf(
+			TEXT("seed spawn of %d boids arrived %d steps late"), SeedSpawn.Count,
+			GetLockstepStep() - SeedSpawn.LockstepStep));
+	}
+
+	FRandomStream RandomStream(SeedSpawn.Seed);
+	TArray<FMSBoidNetSpawnData> SpawnData;
+	SpawnData.Reserve(SeedSpawn.Count);
+	for (int32 i = 0; i < SeedSpawn.Count; ++i)
+	{
+		SpawnData.Add(GenerateBoidRandomData(SeedSpawn.FirstNetId + i, RandomStream));
 	}
-	
-	if (!BoidEntityConfig) return;
 
-	uint32 counter = 0;
+	SpawnBoidsFromData(SpawnData);
+}
+
+void UMSBoidSubsystem::SpawnDueSeedSpawns(UWorld* World, ELevelTick TickType, float DeltaSeconds)
+{
+	if (World != GetWorld()) return;
 
-	for (const FMSBoidNetSpawnData& BoidData : NewBoidData)
+	while (IsSeedSpawnDue())
 	{
-		FEntityHandleWrapper NewBoid = UMSBPFunctionLibrary::SpawnEntityFromEntityConfig(
-			BoidEntityConfig,
-			GetWorld(),
-			false
-		);
+		const FMSBoidSeedSpawn SeedSpawn = PendingSeedSpawns[0];
+		PendingSeedSpawns.RemoveAt(0);
+		SpawnBoidsFromSeed(SeedSpawn);
+	}
+}
+
+void UMSBoidSubsystem::RecordLockstepChecksum()
+{
+	if (!bLockstep || !bLockstepStarted) return;
 
-		MassEntitySubsystem->GetFragmentDataChecked<FMSBoidLocationFragment>(NewBoid.Entity).Location = BoidData.Location;
-		MassEntitySubsystem->GetFragmentDataChecked<FMSBoidVelocityFragment>(NewBoid.Entity).Velocity = BoidData.Velocity;
+	const int32 LockstepStep = GetLockstepStep();
+	if (LockstepStep % LockstepChecksumInterval != 0) return;
 
-		int32 HismIndex = counter;
-		++counter;
+	// Slots are handed out in spawn order, which is the same everywhere as long as all boids come from seeds
+	const FMSBoidStateBuffer& ReadBuffer = GetReadStateBuffer();
+	uint32 Checksum = FCrc::MemCrc32(ReadBuffer.Locations.GetData(), ReadBuffer.Locations.Num() * sizeof(FVector));
+	Checksum = FCrc::MemCrc32(ReadBuffer.Velocities.GetData(), ReadBuffer.Velocities.Num() * sizeof(FVector), Checksum);
+
+	if (GetWorld()->GetNetMode() != ENetMode::NM_Client)
+	{
+		BoidReplicator->NetCastStepChecksum(LockstepStep, Checksum);
+		return;
+	}
+
+	if (bLockstepDesynced) return;
+
+	LocalChecksums.Add(LockstepStep, Checksum);
+	CompareLockstepChecksums(LockstepStep);
+}
 
-		if (!BoidSettings->UseNiagara)
+void UMSBoidSubsystem::ReceiveServerChecksum(const int32 LockstepStep, const uint32 Checksum)
+{
+	if (bLockstepDesynced) return;
+
+	ServerChecksums.Add(LockstepStep, Checksum);
+	CompareLockstepChecksums(LockstepStep);
+}
+
+void UMSBoidSubsystem::CompareLockstepChecksums(const int32 LockstepStep)
+{
+	const uint32* LocalChecksum = LocalChecksums.Find(LockstepStep);
+	const uint32* ServerChecksum = ServerChecksums.Find(LockstepStep);
+
+	if (LocalChecksum && ServerChecksum)
+	{
+		if (*LocalChecksum != *ServerChecksum)
 		{
-			HismIndex = Hism->AddInstance(FTransform(BoidData.Location), true);
+			ReportLockstepDesync(LockstepStep, FString::Printf(TEXT("checksum %08x, server has %08x"),
+			                                                   *LocalChecksum, *ServerChecksum));
 		}
-		else
+		LocalChecksums.Remove(LockstepStep);
+		ServerChecksums.Remove(LockstepStep);
+	}
+
+	// Checksums lost on the way never get their pair, forget them once they are far enough behind
+	const int32 OldestKept = LockstepStep - 64 * LockstepChecksumInterval;
+	for (auto It = LocalChecksums.CreateIterator(); It; ++It)
+	{
+		if (It.Key() < OldestKept) It.RemoveCurrent();
+	}
+	for (auto It = ServerChecksums.CreateIterator(); It; ++It)
+	{
+		if (It.Key() < OldestKept) It.RemoveCurrent();
+	}
+}
+
+void UMSBoidSubsystem::ReportLockstepDesync(const int32 LockstepStep, const FString& Reason)
+{
+	bLockstepDesynced = true;
+
+	UE_LOG(LogTemp, Warning, TEXT("UMSBoidSubsystem lockstep desync at step %d: %s. Local step %d, %d boids, %d seed spawns pending. Falling back to location updates."),
+	       LockstepStep, *Reason, GetLockstepStep(), GetReadStateBuffer().Locations.Num(), PendingSeedSpawns.Num());
+
+	if (AMSBoidPlayerController* PlayerController = Cast<AMSBoidPlayerController>(GetWorld()->GetFirstPlayerController()))
+	{
+		PlayerController->ServerReportBoidDesync(LockstepStep);
+	}
+}
+
+bool UMSBoidSubsystem::AllocateNetId(uint16& OutNetId)
+{
+	if (FreeNetIds.Num() > 0)
+	{
+		OutNetId = FreeNetIds.Pop(false);
+		return true;
+	}
+
+	if (NextNetId > MAX_uint16) return false;
+
+	OutNetId = NextNetId++;
+	return true;
+}
+
+void UMSBoidSubsystem::ReleaseNetId(const uint16 NetId)
+{
+	if (!NetIdHandles.IsValidIndex(NetId) || !NetIdHandles[NetId].IsSet()) return;
+
+	NetIdHandles[NetId] = FMassEntityHandle();
+	if (GetWorld()->GetNetMode() == ENetMode::NM_Client) return;
+
+	// Not free yet, a client still holding the old boid would take the next one with this id for it
+	if (BoidReplicator) BoidReplicator->RemoveBoid(NetId);
+	else FreeNetIds.Push(NetId);
+}
+
+int32 UMSBoidSubsystem::AdvanceSimulationClock(const float FrameDeltaTime)
+{
+	if (!bFixedStepSimulation)
+	{
+		SimulationStepTime = FrameDeltaTime;
+		InterpolationAlpha = 1.0f;
+		return 1;
+	}
+
+	SimulationStepTime = FixedStepTime;
+	SimulationTimeAccumulator += FrameDeltaTime;
+
+	int32 NumSteps = FMath::FloorToInt(SimulationTimeAccumulator / FixedStepTime);
+	if (NumSteps > MaxStepsPerFrame)
+	{
+		// Drop the backlog past the cap, the flock just slows down during the hitch
+		SimulationTimeAccumulator = FMath::Fmod(SimulationTimeAccumulator, FixedStepTime) + MaxStepsPerFrame * FixedStepTime;
+		NumSteps = MaxStepsPerFrame;
+	}
+
+	SimulationTimeAccumulator -= NumSteps * FixedStepTime;
+	InterpolationAlpha = FMath::Clamp(SimulationTimeAccumulator / FixedStepTime, 0.0f, 1.0f);
+
+	return NumSteps;
+}
+
+const FMSBoidStateBuffer& UMSBoidSubsystem::UpdateRenderStateBuffer()
+{
+	const FMSBoidStateBuffer& ReadBuffer = GetReadStateBuffer();
+	if (InterpolationAlpha >= 1.0f) return ReadBuffer;
+
+	const FMSBoidStateBuffer& PreviousBuffer = GetPreviousStateBuffer();
+	const float Alpha = InterpolationAlpha;
+	const int32 NumSlots = ReadBuffer.Locations.Num();
+
+	RenderStateBuffer.Locations.SetNumUninitialized(NumSlots, false);
+	RenderStateBuffer.Velocities.SetNumUninitialized(NumSlots, false);
+
+	// Blocks of slots rather than chunks, slots are dense and every block writes its own range
+	constexpr int32 BlockSize = 4096;
+	ParallelFor(FMath::DivideAndRoundUp(NumSlots, BlockSize), [&](const int32 BlockIndex)
+	{
+		const int32 Begin = BlockIndex * BlockSize;
+		const int32 End = FMath::Min(Begin + BlockSize, NumSlots);
+
+		for (int32 Slot = Begin; Slot < End; ++Slot)
 		{
-			Hism->AddInstance(FTransform(), true);
+			RenderStateBuffer.Locations[Slot] = FMath::Lerp(PreviousBuffer.Locations[Slot], ReadBuffer.Locations[Slot],
+			                                                Alpha);
+			RenderStateBuffer.Velocities[Slot] = FMath::Lerp(PreviousBuffer.Velocities[Slot],
+			                                                 ReadBuffer.Velocities[Slot], Alpha);
 		}
-		MassEntitySubsystem->GetFragmentDataChecked<FMSBoidRenderFragment>(NewBoid.Entity).HismId = HismIndex;
+	});
+
+	return RenderStateBuffer;
+}
 
-		MassEntitySubsystem->GetFragmentDataChecked<FMSBoidNetId>(NewBoid.Entity).Id = BoidData.NetId;
+void UMSBoidSubsystem::RebuildSpatialIndex()
+{
+	const FMSBoidStateBuffer& ReadBuffer = GetReadStateBuffer();
 
-		FMSBoid NewBoidStruct = FMSBoid(
-			BoidData.Location,
-			BoidData.Velocity,
-			BoidData.NetId
-		);
+	switch (SpatialBackend)
+	{
+	case EMSBoidSpatialBackend::Octree:
+		BoidOctree->Destroy();
+		for (int32 Slot = 0; Slot < ReadBuffer.Locations.Num(); ++Slot)
+		{
+			BoidOctree->AddElement(FMSBoid(ReadBuffer.Locations[Slot], ReadBuffer.Velocities[Slot], 0));
+		}
+		bOctreeElementIdsStale = true;
+		break;
 
-		NetIdMassHandleMap.Add(BoidData.NetId, NewBoid.Entity);
-		
-		// HashGrid.InsertPoint(NewBoid.Entity, BoidData.Location);
+	case EMSBoidSpatialBackend::HashGrid:
+		HashGrid.Build(SlotEntities, ReadBuffer.Locations, ReadBuffer.Velocities, BoidSightRadius);
+		break;
+
+	case EMSBoidSpatialBackend::LinearOctree:
+		LinearOctree.Build(ReadBuffer.Locations, ReadBuffer.Velocities, BoidSightRadius);
+		break;
+	}
+}
+
+int32 UMSBoidSubsystem::AllocateBoidSlot(const FMassEntityHandle Entity, const FVector& Location, const FVector& Velocity)
+{
+	SlotEntities.Add(Entity);
+
+	for (FMSBoidStateBuffer& StateBuffer : StateBuffers)
+	{
+		StateBuffer.Locations.Add(Location);
+		StateBuffer.Velocities.Add(Velocity);
+	}
+
+	return StateBuffers[0].Locations.Num() - 1;
+}
+
+void UMSBoidSubsystem::ReleaseBoidSlot(const int32 Slot)
+{
+	if (!SlotEntities.IsValidIndex(Slot)) return;
+
+	// The last slot moves into the hole, so the buffers stay dense for Niagara and the spatial index builds
+	const int32 LastSlot = SlotEntities.Num() - 1;
+	if (Slot != LastSlot)
+	{
+		const FMassEntityHandle MovedEntity = SlotEntities[LastSlot];
+		SlotEntities[Slot] = MovedEntity;
+		for (FMSBoidStateBuffer& StateBuffer : StateBuffers)
+		{
+			StateBuffer.Locations[Slot] = StateBuffer.Locations[LastSlot];
+			StateBuffer.Velocities[Slot] = StateBuffer.Velocities[LastSlot];
+		}
+		MassEntitySubsystem->GetFragmentDataChecked<FMSBoidSlotFragment>(MovedEntity).Slot = Slot;
+	}
+
+	SlotEntities.Pop(false);
+	for (FMSBoidStateBuffer& StateBuffer : StateBuffers)
+	{
+		StateBuffer.Locations.Pop(false);
+		StateBuffer.Velocities.Pop(false);
+	}
+}
+
+void UMSBoidSubsystem::ReleaseHismInstance(const int32 HismId)
+{
+	const int32 LastInstance = Hism->GetInstanceCount() - 1;
+	if (LastInstance < 0) return;
+
+	// Removing the last instance never reorders the others, so the hole is filled by hand the same way slots are.
+	// With Niagara the instances are all the same and only kept for their count.
+	if (!BoidSettings->UseNiagara && HismId != LastInstance && HismEntities.IsValidIndex(HismId) &&
+		HismEntities.IsValidIndex(LastInstance))
+	{
+		FTransform LastTransform;
+		Hism->GetInstanceTransform(LastInstance, LastTransform, true);
+		Hism->UpdateInstanceTransform(HismId, LastTransform, true, false, true);
+
+		const FMassEntityHandle MovedEntity = HismEntities[LastInstance];
+		HismEntities[HismId] = MovedEntity;
+		MassEntitySubsystem->GetFragmentDataChecked<FMSBoidRenderFragment>(MovedEntity).HismId = HismId;
+	}
+
+	Hism->RemoveInstance(LastInstance);
+	if (HismEntities.IsValidIndex(LastInstance)) HismEntities.SetNum(LastInstance, false);
+}
+
+int32 UMSBoidSubsystem::GetBoidSlot(const FMassEntityHandle Entity) const
+{
+	return MassEntitySubsystem->GetFragmentDataChecked<FMSBoidSlotFragment>(Entity).Slot;
+}
+
+void UMSBoidSubsystem::SpawnBoidsFromData(const TArray<FMSBoidNetSpawnData>& NewBoidData)
+{
+	const bool bIsClient = GetWorld()->GetNetMode() == ENetMode::NM_Client;
+	if (bIsClient)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("UMSBoidSubsystem::SpawnBoidsFromData() in client num: %d"), NewBoidData.Num());
+	}
+	
+	if (!BoidEntityConfig) return;
+
+	// A join stream and a multicast spawn can both carry a boid that reused a freed net id, the first one wins
+	TArray<FMSBoidNetSpawnData> FilteredBoidData;
+	if (bIsClient)
+	{
+		FilteredBoidData.Reserve(NewBoidData.Num());
+		for (const FMSBoidNetSpawnData& BoidData : NewBoidData)
+		{
+			if (!GetBoidByNetId(BoidData.NetId).IsSet()) FilteredBoidData.Add(BoidData);
+		}
+	}
+	const TArray<FMSBoidNetSpawnData>& BoidsToSpawn = bIsClient ? FilteredBoidData : NewBoidData;
+	const int32 NumBoids = BoidsToSpawn.Num();
+	if (NumBoids == 0) return;
+
+	if (!BoidSpawnTemplate)
+	{
+		BoidSpawnTemplate = FMSEntitySpawnTemplate(BoidEntityConfig, GetWorld());
+		BoidSpawnTemplate.FinalizeTemplateArchetype(MassEntitySubsystem);
+	}
+	const FMassArchetypeHandle& Archetype = BoidSpawnTemplate.Template.GetArchetype();
+
+	TArray<FMassEntityHandle> NewEntities;
+	MassEntitySubsystem->BatchCreateEntities(Archetype, NumBoids, NewEntities);
+	++BoidPopulationVersion;
+
+	const FMassArchetypeSubChunks NewChunks(Archetype, NewEntities, FMassArchetypeSubChunks::NoDuplicates);
+	MassEntitySubsystem->BatchSetEntityFragmentsValues(NewChunks, BoidSpawnTemplate.Template.GetInitialFragmentValues());
+
+	// One call for all the instances, so the HISM rebuilds its render data once instead of once per boid
+	TArray<FTransform> InstanceTransforms;
+	InstanceTransforms.Reserve(NumBoids);
+	for (const FMSBoidNetSpawnData& BoidData : BoidsToSpawn)
+	{
+		InstanceTransforms.Add(BoidSettings->UseNiagara ? FTransform() : FTransform(BoidData.Location));
+	}
+	const TArray<int32> HismIndices = Hism->AddInstances(InstanceTransforms, true, true);
+	for (int32 i = 0; i < NumBoids; ++i)
+	{
+		if (!HismEntities.IsValidIndex(HismIndices[i])) HismEntities.SetNum(HismIndices[i] + 1, false);
+		HismEntities[HismIndices[i]] = NewEntities[i];
+	}
+
+	// Slots go in spawn data order rather than chunk order, lockstep peers must lay out their state buffers the same
+	TArray<int32> NewSlots;
+	NewSlots.SetNumUninitialized(NumBoids);
+	for (int32 i = 0; i < NumBoids; ++i)
+	{
+		const FMSBoidNetSpawnData& BoidData = BoidsToSpawn[i];
+		const FMassEntityHandle Entity = NewEntities[i];
+
+		if (!SpawnDataIndices.IsValidIndex(Entity.Index)) SpawnDataIndices.SetNumUninitialized(Entity.Index + 1, false);
+		SpawnDataIndices[Entity.Index] = i;
+		NewSlots[i] = AllocateBoidSlot(Entity, BoidData.Location, BoidData.Velocity);
+
+		if (!NetIdHandles.IsValidIndex(BoidData.NetId)) NetIdHandles.SetNum(BoidData.NetId + 1);
+		NetIdHandles[BoidData.NetId] = Entity;
+		if (!EntityNetIds.IsValidIndex(Entity.Index)) EntityNetIds.SetNumUninitialized(Entity.Index + 1, false);
+		EntityNetIds[Entity.Index] = BoidData.NetId;
 
 		if (bDrawDebugBoxes) UE_LOG(LogTemp, Warning, TEXT("UMSBoidSubsystem::SpawnBoid() id: %d, location: %s"),
-							NewBoid.Entity.Index, *BoidData.Location.ToString());
+		                            Entity.Index, *BoidData.Location.ToString());
 
 		// only add to replicator if server
-		if (GetWorld()->GetNetMode() == ENetMode::NM_Client) continue;
+		if (bIsClient) continue;
+
+		BoidReplicator->AddBoid(FMSBoid(BoidData.Location, BoidData.Velocity, BoidData.NetId));
+	}
+
+	SpawnQuery.ForEachEntityChunk(NewChunks, *MassEntitySubsystem, Context,
+		[this, &BoidsToSpawn, &HismIndices, &NewSlots](FMassExecutionContext& ChunkContext)
+	{
+		const int32 NumEntities = ChunkContext.GetNumEntities();
+		const auto Renders = ChunkContext.GetMutableFragmentView<FMSBoidRenderFragment>();
+		const auto NetIds = ChunkContext.GetMutableFragmentView<FMSBoidNetId>();
+		const auto Slots = ChunkContext.GetMutableFragmentView<FMSBoidSlotFragment>();
+
+		for (int32 i = 0; i < NumEntities; ++i)
+		{
+			const int32 DataIndex = SpawnDataIndices[ChunkContext.GetEntity(i).Index];
+			const FMSBoidNetSpawnData& BoidData = BoidsToSpawn[DataIndex];
+
+			// Niagara reads the boids by slot, the HISM instances are only kept around for their count
+			Renders[i].HismId = BoidSettings->UseNiagara ? INDEX_NONE : HismIndices[DataIndex];
+			NetIds[i].Id = BoidData.NetId;
+			Slots[i].Slot = NewSlots[DataIndex];
+		}
+	});
+}
+
+int32 UMSBoidSubsystem::GatherSpawnData(const int32 FirstNetId, const int32 EndNetId, const int32 MaxBoids,
+                                        TArray<FMSBoidNetSpawnData>& OutSpawnData) const
+{
+	const int32 LastNetId = FMath::Min(EndNetId, NetIdHandles.Num());
+	const FMSBoidStateBuffer& ReadBuffer = GetReadStateBuffer();
 
-		BoidReplicator->AddBoid(NewBoidStruct);
+	int32 NetId = FirstNetId;
+	int32 NumAdded = 0;
+	for (; NetId < LastNetId && NumAdded < MaxBoids; ++NetId)
+	{
+		const FMassEntityHandle Entity = NetIdHandles[NetId];
+		if (!Entity.IsSet()) continue;
+
+		const int32 Slot = GetBoidSlot(Entity);
+		OutSpawnData.Add(FMSBoidNetSpawnData(NetId, ReadBuffer.Locations[Slot], ReadBuffer.Velocities[Slot]));
+		++NumAdded;
 	}
+
+	return NetId < LastNetId ? NetId : EndNetId;
 }
@@ -5,14 +5,33 @@
 #include "CoreMinimal.h"
 #include "MassEntityConfigAsset.h"
 #include "MassEntitySubsystem.h"
+#include "MSBoidDevSettings.h"
+#include "MSBoidHashGrid.h"
+#include "MSBoidLinearOctree.h"
 #include "MSBoidOctree.h"
 #include "MSBoidReplicator.h"
 #include "NiagaraComponent.h"
-#include "Common/Fragments/MSHashGridFragments.h"
+#include "Experimental/MSEntityUtils.h"
 #include "MSBoidSubsystem.generated.h"
 
-class UMSBoidDevSettings;
 class UMassEntitySubsystem;
+
+/** Boids every peer generates by itself from the same seed, spawned right before the same lockstep step everywhere */
+struct FMSBoidSeedSpawn
+{
+	int32 Seed = 0;
+	int32 FirstNetId = 0;
+	int32 Count = 0;
+	int32 LockstepStep = 0;
+};
+
+/** Location and velocity of every boid, indexed by FMSBoidSlotFragment::Slot */
+struct FMSBoidStateBuffer
+{
+	TArray<FVector> Locations;
+	TArray<FVector> Velocities;
+};
+
 /**
  * 
  */
@@ -25,15 +44,149 @@ class MASSSAMPLE_API UMSBoidSubsystem : public UWorldSubsystem
 
 	virtual void OnWorldBeginPlay(UWorld& InWorld) override;
 
+	virtual void Deinitialize() override;
+
 public:
 	TArray<FMSBoid> GetBoidsInRadius(const FBoxCenterAndExtent& QueryBox);
+
+	/** Only the hash grid backend keeps entity handles, with any other backend this returns nothing */
 	TArray<FMassEntityHandle> GetBoidsInRadius(FVector Center, float Radius);
 
+	/**
+	 * Visits every boid inside the sphere straight from the selected spatial backend, without building any
+	 * intermediate container. Func is called as Func(const FVector& Location, const FVector& Velocity).
+	 */
+	template<typename FunctionType>
+	void ForEachBoidInRadius(const FVector& Center, const float Radius, const FunctionType& Func) const
+	{
+		const float RadiusSquared = Radius * Radius;
+
+		switch (SpatialBackend)
+		{
+		case EMSBoidSpatialBackend::Octree:
+			BoidOctree->FindElementsWithBoundsTest(FBoxCenterAndExtent(Center, FVector(Radius)), [&](const FMSBoid& Boid)
+			{
+				if (FVector::DistSquared(Center, Boid.Location) < RadiusSquared)
+				{
+					Func(Boid.Location, Boid.Velocity);
+				}
+			});
+			break;
+
+		case EMSBoidSpatialBackend::HashGrid:
+			HashGrid.ForEachBoidInRadius(Center, Radius, Func);
+			break;
+
+		case EMSBoidSpatialBackend::LinearOctree:
+			LinearOctree.ForEachBoidInRadius(Center, Radius, Func);
+			break;
+		}
+	}
+
+	/** State of the last finished movement step, nothing writes to it until the buffers are swapped */
+	const FMSBoidStateBuffer& GetReadStateBuffer() const { return StateBuffers[ReadStateBufferIndex]; }
+
+	/** Where the running movement step puts its results, each slot is only written by its own boid */
+	FMSBoidStateBuffer& GetWriteStateBuffer() { return StateBuffers[ReadStateBufferIndex ^ 1]; }
+
+	/** For net corrections between steps, they change the state the next step starts from */
+	FMSBoidStateBuffer& GetMutableReadStateBuffer() { return StateBuffers[ReadStateBufferIndex]; }
+
+	/** Slot of the boid in the state buffers, the buffers are the only place its location and velocity live */
+	int32 GetBoidSlot(FMassEntityHandle Entity) const;
+
+	/** Frees a destroyed boid's slot by moving the last slot into it, the moved boid's slot fragment is updated */
+	void ReleaseBoidSlot(int32 Slot);
+
+	/** Removes a destroyed boid's HISM instance by moving the last instance into it, the moved boid's render fragment
+	 *  is updated */
+	void ReleaseHismInstance(int32 HismId);
+
+	/** Entity of every slot, in the same order as the state buffers */
+	TConstArrayView<FMassEntityHandle> GetSlotEntities() const { return SlotEntities; }
+
+	/** Net id of a live boid, without going through its fragments */
+	uint16 GetBoidNetId(const FMassEntityHandle Entity) const { return EntityNetIds[Entity.Index]; }
+
+	/** State before the last finished step, only meaningful between movement and the next movement */
+	const FMSBoidStateBuffer& GetPreviousStateBuffer() const { return StateBuffers[ReadStateBufferIndex ^ 1]; }
+
+	/**
+	 * State to draw this frame, indexed by slot. That is the read buffer itself unless rendering interpolates, then
+	 * the persistent render buffer gets the blend of the previous and read buffers, filled in parallel.
+	 */
+	const FMSBoidStateBuffer& UpdateRenderStateBuffer();
+
+	/** Publishes the write buffer as the new read buffer, called once per finished movement step */
+	void SwapStateBuffers()
+	{
+		ReadStateBufferIndex ^= 1;
+		++SimulationStep;
+	}
+
+	/** Advances the simulation clock by the frame time and returns how many movement steps to run this frame */
+	int32 AdvanceSimulationClock(float FrameDeltaTime);
+
+	/** Length of the steps handed out by the last AdvanceSimulationClock */
+	float GetSimulationStepTime() const { return SimulationStepTime; }
+
+	/** Where rendering sits between the previous and the read state buffer, 1 when not simulating in fixed steps */
+	float GetInterpolationAlpha() const { return InterpolationAlpha; }
+
+	/** Number of movement steps simulated so far */
+	uint32 GetSimulationStep() const { return SimulationStep; }
+
+	/** Rebuilds the selected spatial index from the read state buffer, used between steps of the same frame */
+	void RebuildSpatialIndex();
+
+	/** Creates the whole batch of boids with a single BatchCreateEntities and fills their fragments in chunk by chunk */
 	void SpawnBoidsFromData(const TArray<FMSBoidNetSpawnData>& NewBoidData);
 
+	/**
+	 * Server side. Adds the current state of the boids with net ids from FirstNetId on, until MaxBoids are added or
+	 * EndNetId is reached. Returns the net id to carry on from.
+	 */
+	int32 GatherSpawnData(int32 FirstNetId, int32 EndNetId, int32 MaxBoids, TArray<FMSBoidNetSpawnData>& OutSpawnData) const;
+
 	UFUNCTION(BlueprintCallable)
 	void SpawnRandomBoids();
 
+	/** Lockstep mode, every peer simulates the boids by itself and only checksums and corrections go over the net */
+	bool IsLockstep() const { return bLockstep; }
+
+	/** Lockstep. Whether the first seed spawn went through, before it there are no boids to be out of step with */
+	bool HasLockstepStarted() const { return bLockstepStarted; }
+
+	/** Steps simulated since the first seed spawn, the same step number means the same state on every peer */
+	int32 GetLockstepStep() const { return (int32)SimulationStep - LockstepOrigin; }
+
+	/** Spawns the seed's boids now if their step has come, otherwise queues them until it has */
+	void SpawnBoidsFromSeed(const FMSBoidSeedSpawn& SeedSpawn);
+
+	/** A queued seed spawn is due before the next step, movement has to stop so it can spawn outside of processing */
+	bool IsSeedSpawnDue() const
+	{
+		return PendingSeedSpawns.Num() > 0 && GetLockstepStep() >= PendingSeedSpawns[0].LockstepStep;
+	}
+
+	/** Hands steps the movement didn't run back to the clock, so they run next frame */
+	void DeferSimulationSteps(const int32 NumSteps) { SimulationTimeAccumulator += NumSteps * FixedStepTime; }
+
+	/** Checksums the read state buffer every LockstepChecksumInterval steps, called after each step in lockstep */
+	void RecordLockstepChecksum();
+
+	/** Client side. Compares the server's checksum against ours for the same step, now or once we get there */
+	void ReceiveServerChecksum(int32 LockstepStep, uint32 Checksum);
+
+	/** Set once the boids drifted apart, from then on the replicator streams locations to correct them */
+	bool bLockstepDesynced = false;
+
+	/** Server side. Whether a client's desync report names a step that could have been checked at all */
+	bool IsValidDesyncReport(int32 LockstepStep) const;
+
+	/** Seconds the server ignores further desync reports from a client after taking one */
+	float LockstepDesyncReportCooldown = 5.0f;
+
 	UPROPERTY(Transient)
 	UMassEntitySubsystem* MassEntitySubsystem;
 
@@ -46,7 +199,20 @@ public:
 	
 	TUniquePtr<FMSBoidOctree> BoidOctree;
 
-	FMSHashGrid3D HashGrid = FMSHashGrid3D(100.0f,FMassEntityHandle());
+	FMSBoidHashGrid HashGrid;
+
+	FMSBoidLinearOctree LinearOctree;
+
+	EMSBoidSpatialBackend SpatialBackend;
+
+	/** Set when the octree was rebuilt without entity handles, so its processor can't update it incrementally */
+	bool bOctreeElementIdsStale = false;
+
+	/** Octree element of every boid, written by the octree itself whenever an element moves */
+	FMSBoidOctreeElementIds OctreeElementIds;
+
+	/** Bumped whenever boids are spawned or destroyed, incrementally updated indices rebuild when it changes */
+	uint32 BoidPopulationVersion = 0;
 
 	UPROPERTY()
 	UHierarchicalInstancedStaticMeshComponent* Hism = nullptr;
@@ -57,8 +223,23 @@ public:
 	UPROPERTY()
 	UMSBoidDevSettings* BoidSettings;
 
-	UPROPERTY()
-	TMap<uint16, FMassEntityHandle> NetIdMassHandleMap;
+	/** Entity of the boid with the net id, unset when no boid has it */
+	FMassEntityHandle GetBoidByNetId(const uint16 NetId) const
+	{
+		return NetIdHandles.IsValidIndex(NetId) ? NetIdHandles[NetId] : FMassEntityHandle();
+	}
+
+	/** Highest net id in use plus one, every net indexed array needs at least this many entries */
+	int32 GetNetIdCapacity() const { return NetIdHandles.Num(); }
+
+	/**
+	 * Forgets the boid behind the id. On the server its replication state goes with it, and the replicator tells the
+	 * clients before the id goes back up for reuse through RecycleNetIds.
+	 */
+	void ReleaseNetId(uint16 NetId);
+
+	/** Server side. Ids whose release the clients have been sent, a later spawn can take them */
+	void RecycleNetIds(TConstArrayView<uint16> NetIds) { FreeNetIds.Append(NetIds.GetData(), NetIds.Num()); }
 	
 	void DrawDebugOctree();
 
@@ -81,13 +262,87 @@ public:
 	float CohesionWeight = 0.5;
 
 private:
-	FMSBoidNetSpawnData GenerateBoidRandomData();
+	FMSBoidNetSpawnData GenerateBoidRandomData(uint16 NetId);
+
+	/** Same as GenerateBoidRandomData, drawing from the stream so every peer gets the same boids */
+	FMSBoidNetSpawnData GenerateBoidRandomData(uint16 NetId, FRandomStream& RandomStream) const;
+
+	/** Spawns the seed spawns whose step has come, at the start of the world tick before any processor runs */
+	void SpawnDueSeedSpawns(UWorld* World, ELevelTick TickType, float DeltaSeconds);
+
+	/** Compares the two checksums of the step once both are known, and reports a desync when they differ */
+	void CompareLockstepChecksums(int32 LockstepStep);
+
+	/** Logs what we know about the desync and tells the server, which falls back to streaming locations */
+	void ReportLockstepDesync(int32 LockstepStep, const FString& Reason);
+
+	/** Adds a slot to both state buffers, starting out with the same state in each */
+	int32 AllocateBoidSlot(FMassEntityHandle Entity, const FVector& Location, const FVector& Velocity);
+
+	FMSBoidStateBuffer StateBuffers[2];
+	int32 ReadStateBufferIndex = 0;
+
+	/** Interpolated state for rendering, kept between frames so it's never reallocated */
+	FMSBoidStateBuffer RenderStateBuffer;
+
+	/** Entity of every slot, for the spatial indices that hand out handles */
+	TArray<FMassEntityHandle> SlotEntities;
+
+	/** Entity of every HISM instance, so a removed instance can be filled with the last one */
+	TArray<FMassEntityHandle> HismEntities;
+
+	/** Net id of every boid by entity index */
+	TArray<uint16> EntityNetIds;
+
+	bool bFixedStepSimulation;
+	float FixedStepTime;
+	int32 MaxStepsPerFrame;
+
+	float SimulationTimeAccumulator = 0.0f;
+	float SimulationStepTime = 0.0f;
+	float InterpolationAlpha = 1.0f;
+	uint32 SimulationStep = 0;
 
 	int32 SimulationExtentFromCenter;
 	int32 NumOfBoids;
 
-	// just for testing, incremental boid Id to map boids to FMassEntityHandles across the net
-	uint16 NextBoidId = 0;
+	/** Server side. Next never used net id, released ones are recycled through FreeNetIds first */
+	bool AllocateNetId(uint16& OutNetId);
+
+	/** Boid entity by net id, the same on server and clients */
+	TArray<FMassEntityHandle> NetIdHandles;
+
+	TArray<uint16> FreeNetIds;
+	int32 NextNetId = 0;
+
+	/** Boid entity config's template with its archetype, built on the first spawn and reused by every later one */
+	FMSEntitySpawnTemplate BoidSpawnTemplate;
+
+	/** Fragments a spawn fills in, run over the spawned entities only */
+	FMassEntityQuery SpawnQuery;
+
+	/** Spawn data index of every entity of the spawn being filled in, by entity index */
+	TArray<int32> SpawnDataIndices;
+
+	bool bLockstep = false;
+	int32 LockstepChecksumInterval = 30;
+	int32 LockstepSpawnLeadSteps = 15;
+
+	/** Steps from now a new seed spawn is scheduled at, so it reaches every client before it is due */
+	int32 GetSeedSpawnLeadSteps() const;
+
+	/** Simulation step the lockstep steps count from, set by the first seed spawn */
+	int32 LockstepOrigin = 0;
+	bool bLockstepStarted = false;
+
+	/** Client side. Sorted by step */
+	TArray<FMSBoidSeedSpawn> PendingSeedSpawns;
+
+	/** Recent checksums by lockstep step, ours and the server's */
+	TMap<int32, uint32> LocalChecksums;
+	TMap<int32, uint32> ServerChecksums;
+
+	FDelegateHandle WorldTickStartHandle;
 
 public:
 	bool bDrawDebugBoxes;
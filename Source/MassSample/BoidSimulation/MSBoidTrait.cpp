@@ -8,9 +8,9 @@
 
 void UMSBoidTrait::BuildTemplate(FMassEntityTemplateBuildContext& BuildContext, UWorld& World) const
 {
-	BuildContext.AddFragment<FMSBoidLocationFragment>();
-	BuildContext.AddFragment<FMSBoidVelocityFragment>();
 	BuildContext.AddFragment<FMSBoidForcesFragment>();
 	BuildContext.AddFragment<FMSBoidRenderFragment>();
 	BuildContext.AddFragment<FMSBoidNetId>();
+	BuildContext.AddFragment<FMSBoidSlotFragment>();
+	BuildContext.AddFragment<FMSBoidNetCorrectionFragment>();
 }
@@ -0,0 +1,127 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "BoidSimulation/MSBoidFlocking.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace UE::MSBoidFlockingTest
+{
+	/** SoA storage behind a FMSBoidNeighborRange */
+	struct FRangeData
+	{
+		TArray<float> PositionsX, PositionsY, PositionsZ;
+		TArray<float> VelocitiesX, VelocitiesY, VelocitiesZ;
+
+		void Add(const FVector3f& Position, const FVector3f& Velocity)
+		{
+			PositionsX.Add(Position.X);
+			PositionsY.Add(Position.Y);
+			PositionsZ.Add(Position.Z);
+			VelocitiesX.Add(Velocity.X);
+			VelocitiesY.Add(Velocity.Y);
+			VelocitiesZ.Add(Velocity.Z);
+		}
+
+		FMSBoidNeighborRange GetRange() const
+		{
+			return FMSBoidNeighborRange{
+				PositionsX.GetData(), PositionsY.GetData(), PositionsZ.GetData(),
+				VelocitiesX.GetData(), VelocitiesY.GetData(), VelocitiesZ.GetData(), PositionsX.Num()
+			};
+		}
+	};
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMSBoidNeighborAccumulatorExactTest, "MassSample.Boids.NeighborAccumulator.AddRangeExact",
+                                 EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FMSBoidNeighborAccumulatorExactTest::RunTest(const FString& Parameters)
+{
+	using namespace UE::MSBoidFlockingTest;
+
+	// Seven boids so both the four wide loop and the leftovers run, none of them close to the radius
+	const FVector BoidLocation(10.0f, 20.0f, 30.0f);
+	const float Radius = 100.0f;
+	FRangeData Data;
+	Data.Add(FVector3f(10.0f, 20.0f, 30.0f), FVector3f(1.0f, 0.0f, 0.0f));
+	Data.Add(FVector3f(60.0f, 20.0f, 30.0f), FVector3f(0.0f, 1.0f, 0.0f));
+	Data.Add(FVector3f(500.0f, 20.0f, 30.0f), FVector3f(0.0f, 0.0f, 1.0f));
+	Data.Add(FVector3f(10.0f, -30.0f, 30.0f), FVector3f(2.0f, 0.0f, 0.0f));
+	Data.Add(FVector3f(10.0f, 20.0f, -200.0f), FVector3f(0.0f, 2.0f, 0.0f));
+	Data.Add(FVector3f(-20.0f, 40.0f, 50.0f), FVector3f(0.0f, 0.0f, 2.0f));
+	Data.Add(FVector3f(10.0f, 20.0f, 250.0f), FVector3f(3.0f, 0.0f, 0.0f));
+
+	FMSBoidNeighborAccumulator Vectorized;
+	Vectorized.AddRange(BoidLocation, Radius * Radius, Data.GetRange());
+
+	FMSBoidNeighborAccumulator Scalar;
+	Scalar.AddRangeScalar(BoidLocation, Radius * Radius, Data.GetRange());
+
+	TestEqual(TEXT("Vectorized neighbor count"), Vectorized.Count, 4);
+	TestEqual(TEXT("Scalar neighbor count"), Scalar.Count, 4);
+	TestEqual(TEXT("Velocity sum"), Vectorized.VelocitySum, FVector(3.0f, 1.0f, 2.0f));
+	TestEqual(TEXT("Velocity sums match"), Vectorized.VelocitySum, Scalar.VelocitySum);
+	TestEqual(TEXT("Location sums match"), Vectorized.LocationSum, Scalar.LocationSum);
+	TestEqual(TEXT("Repulsion sums match"), Vectorized.RepulsionSum, Scalar.RepulsionSum);
+
+	FMSBoidNeighborAccumulator Empty;
+	Empty.AddRange(BoidLocation, Radius * Radius, FRangeData().GetRange());
+	TestEqual(TEXT("Empty range adds nothing"), Empty.Count, 0);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMSBoidNeighborAccumulatorRandomTest, "MassSample.Boids.NeighborAccumulator.AddRangeRandom",
+                                 EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FMSBoidNeighborAccumulatorRandomTest::RunTest(const FString& Parameters)
+{
+	using namespace UE::MSBoidFlockingTest;
+
+	FRandomStream RandomStream(1234);
+	const float Radius = 100.0f;
+
+	for (int32 Iteration = 0; Iteration < 200; ++Iteration)
+	{
+		// Every length from empty up to several registers plus leftovers
+		const int32 NumBoids = Iteration % 38;
+		const FVector BoidLocation = RandomStream.VRand() * RandomStream.FRandRange(0.0f, 5000.0f);
+
+		FRangeData Data;
+		for (int32 i = 0; i < NumBoids; ++i)
+		{
+			Data.Add(FVector3f(BoidLocation + RandomStream.VRand() * RandomStream.FRandRange(0.0f, 2.0f * Radius)),
+			         FVector3f(RandomStream.VRand() * 100.0f));
+		}
+
+		FMSBoidNeighborAccumulator Vectorized;
+		Vectorized.AddRange(BoidLocation, Radius * Radius, Data.GetRange());
+
+		FMSBoidNeighborAccumulator Scalar;
+		Scalar.AddRangeScalar(BoidLocation, Radius * Radius, Data.GetRange());
+
+		// A boid right on the radius may go either way when the vector path fuses its multiply-adds
+		if (!TestTrue(FString::Printf(TEXT("Iteration %d neighbor counts %d and %d"), Iteration, Vectorized.Count, Scalar.Count),
+		              FMath::Abs(Vectorized.Count - Scalar.Count) <= 1))
+		{
+			return false;
+		}
+
+		if (Vectorized.Count == Scalar.Count)
+		{
+			// Only the order of the float additions differs
+			const float Tolerance = 1e-3f * FMath::Max(1.0f, (float)Scalar.LocationSum.GetAbsMax());
+			TestTrue(FString::Printf(TEXT("Iteration %d location sums"), Iteration),
+			         Vectorized.LocationSum.Equals(Scalar.LocationSum, Tolerance));
+			TestTrue(FString::Printf(TEXT("Iteration %d velocity sums"), Iteration),
+			         Vectorized.VelocitySum.Equals(Scalar.VelocitySum, 1e-2f));
+			TestTrue(FString::Printf(TEXT("Iteration %d repulsion sums"), Iteration),
+			         Vectorized.RepulsionSum.Equals(Scalar.RepulsionSum, Tolerance));
+		}
+	}
+
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
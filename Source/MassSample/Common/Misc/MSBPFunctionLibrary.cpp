@@ -14,6 +14,7 @@
 #include "AI/NavigationSystemBase.h"
 #include "Common/Fragments/MSFragments.h"
 #include "Experimental/MSEntityUtils.h"
+#include "ProjectileSim/MSProjectileSubsystem.h"
 #include "ProjectileSim/Fragments/MSProjectileFragments.h"
 
 FEntityHandleWrapper UMSBPFunctionLibrary::SpawnEntityFromEntityConfig(UMassEntityConfigAsset* MassEntityConfig,
@@ -38,6 +39,13 @@ FEntityHandleWrapper UMSBPFunctionLibrary::SpawnEntityFromEntityConfig(UMassEnti
 		MassEntitySpawnData.Template.AddFragment_GetRef<FTransformFragment>().GetMutableTransform().SetTranslation(
 			FMath::VRand());
 
+		// Pooled projectiles that hit something come back before a new entity gets made
+		if (UMSProjectileSubsystem* ProjectileSubsystem = WorldContextObject->GetWorld()->GetSubsystem<UMSProjectileSubsystem>())
+		{
+			const FMassEntityHandle PooledEntity = ProjectileSubsystem->TryReusePooledProjectile(MassEntitySpawnData.Template);
+			if (PooledEntity.IsSet()) return FEntityHandleWrapper{PooledEntity};
+		}
+
 		// Finalize by actually
 		// 1: creating/getting archetype
 		MassEntitySpawnData.FinalizeTemplateArchetype(EntitySubSystem);
@@ -70,6 +78,12 @@ FEntityHandleWrapper UMSBPFunctionLibrary::SpawnEntityFromEntityConfigDeferred(
 		auto EntitySubSystem = WorldContextObject->GetWorld()->GetSubsystem<UMassEntitySubsystem>();
 		auto MassSampleSubSystem = WorldContextObject->GetWorld()->GetSubsystem<UMSSubsystem>();;
 
+		if (UMSProjectileSubsystem* ProjectileSubsystem = WorldContextObject->GetWorld()->GetSubsystem<UMSProjectileSubsystem>())
+		{
+			const FMassEntityHandle PooledEntity = ProjectileSubsystem->TryReusePooledProjectile(*EntityTemplate);
+			if (PooledEntity.IsSet()) return FEntityHandleWrapper{PooledEntity};
+		}
+
 		const FMassEntityHandle ReservedEntity = EntitySubSystem->ReserveEntity();
 
 
@@ -202,7 +216,7 @@ void UMSBPFunctionLibrary::SetEntityCollisionQueryIgnoredActors(const FEntityHan
 	if (const auto CollisionQueryFragment = EntitySubSystem->GetFragmentDataPtr<
 		FLineTraceFragment>(EntityHandle.Entity))
 	{
-		CollisionQueryFragment->QueryParams.AddIgnoredActors(IgnoredActors);
+		CollisionQueryFragment->AddIgnoredActors(IgnoredActors);
 	}
 }
 
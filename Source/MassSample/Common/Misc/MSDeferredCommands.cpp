@@ -3,6 +3,10 @@
 
 #include "MSDeferredCommands.h"
 
+#include "MassEntitySubsystem.h"
+#include "MassObserverManager.h"
+#include "ProjectileSim/Fragments/MSProjectileFragments.h"
+
 
 void FBuildEntityFromFragmentInstancesAndTags::AppendAffectedEntitiesPerType(FMassCommandsObservedTypes& ObservedTypes)
 {
@@ -43,3 +47,62 @@ void FBuildEntityFromFragmentInstancesAndTags::Execute(UMassEntitySubsystem& Ent
 	
 	EntitySystem.SetEntityFragmentsValues(TargetEntity,FragmentInstancesToAdd);
 }
+
+void FBatchAddHitResultFragments::AppendAffectedEntitiesPerType(FMassCommandsObservedTypes& ObservedTypes)
+{
+	// Called on push, before we can tell which entities survive until the flush. Execute notifies the observers
+	// itself, for the entities that actually got the fragment.
+}
+
+void FBatchAddHitResultFragments::Execute(UMassEntitySubsystem& EntitySystem) const
+{
+	// Grouped by archetype so every archetype moves its entities to the one with the fragment in a single batch
+	TMap<FMassArchetypeHandle, TArray<FMassEntityHandle>> AddedByArchetype;
+	for (const FMassEntityHandle Entity : Entities)
+	{
+		// Destroyed since the hit was found
+		if (!EntitySystem.IsEntityValid(Entity)) continue;
+
+		const FMassArchetypeHandle Archetype = EntitySystem.GetArchetypeForEntity(Entity);
+		// Already hit earlier, only the value changes below
+		if (EntitySystem.GetArchetypeComposition(Archetype).Fragments.Contains<FHitResultFragment>()) continue;
+
+		AddedByArchetype.FindOrAdd(Archetype).Add(Entity);
+	}
+
+	TArray<FMassArchetypeSubChunks> AddedChunks;
+	AddedChunks.Reserve(AddedByArchetype.Num());
+	for (const TPair<FMassArchetypeHandle, TArray<FMassEntityHandle>>& Added : AddedByArchetype)
+	{
+		AddedChunks.Emplace(Added.Key, Added.Value, FMassArchetypeSubChunks::NoDuplicates);
+	}
+
+	if (AddedChunks.Num() > 0)
+	{
+		FMassFragmentBitSet FragmentsToAdd;
+		FragmentsToAdd.Add<FHitResultFragment>();
+		EntitySystem.BatchChangeFragmentCompositionForEntities(AddedChunks, FragmentsToAdd, FMassFragmentBitSet());
+	}
+
+	for (int32 i = 0; i < Entities.Num(); ++i)
+	{
+		if (!EntitySystem.IsEntityValid(Entities[i])) continue;
+		EntitySystem.GetFragmentDataChecked<FHitResultFragment>(Entities[i]).HitResult = HitResults[i];
+	}
+
+	// The entities moved archetypes above, collect the chunks again where they live now. Values are set first so
+	// the observers see the hits.
+	TMap<FMassArchetypeHandle, TArray<FMassEntityHandle>> AddedByNewArchetype;
+	for (const TPair<FMassArchetypeHandle, TArray<FMassEntityHandle>>& Added : AddedByArchetype)
+	{
+		for (const FMassEntityHandle Entity : Added.Value)
+		{
+			AddedByNewArchetype.FindOrAdd(EntitySystem.GetArchetypeForEntity(Entity)).Add(Entity);
+		}
+	}
+	for (const TPair<FMassArchetypeHandle, TArray<FMassEntityHandle>>& Added : AddedByNewArchetype)
+	{
+		EntitySystem.GetObserverManager().OnPostFragmentOrTagAdded(*FHitResultFragment::StaticStruct(),
+			FMassArchetypeSubChunks(Added.Key, Added.Value, FMassArchetypeSubChunks::NoDuplicates));
+	}
+}
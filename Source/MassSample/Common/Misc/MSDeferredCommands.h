@@ -4,6 +4,7 @@
 
 #include "CoreMinimal.h"
 #include "MassCommandBuffer.h"
+#include "Engine/HitResult.h"
 #include "MSDeferredCommands.generated.h"
 
 /**
@@ -38,3 +39,35 @@ protected:
 
 	FMassArchetypeSharedFragmentValues SharedFragmentValuesToAdd;
 };
+
+/**
+* Adds a FHitResultFragment to every entity of the list in one command, for processors collecting hits on several threads.
+* Entities change archetype in one batch per archetype, and only the ones still alive at the flush reach the observers.
+*/
+USTRUCT()
+struct MASSSAMPLE_API FBatchAddHitResultFragments : public FCommandBufferEntryBase
+{
+	GENERATED_BODY()
+	enum
+	{
+		Type = ECommandBufferOperationType::Add
+	};
+
+	FBatchAddHitResultFragments() = default;
+	FBatchAddHitResultFragments(TArray<FMassEntityHandle>&& InEntities, TArray<FHitResult>&& InHitResults)
+		: FCommandBufferEntryBase(InEntities.Num() > 0 ? InEntities[0] : FMassEntityHandle())
+		, Entities(MoveTemp(InEntities))
+		, HitResults(MoveTemp(InHitResults))
+	{
+		check(Entities.Num() == HitResults.Num());
+	}
+
+	void AppendAffectedEntitiesPerType(FMassCommandsObservedTypes& ObservedTypes);
+
+protected:
+	virtual void Execute(UMassEntitySubsystem& EntitySystem) const override;
+
+	TArray<FMassEntityHandle> Entities;
+
+	TArray<FHitResult> HitResults;
+};
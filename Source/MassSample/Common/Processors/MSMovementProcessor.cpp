@@ -5,6 +5,7 @@
 #include "MassCommon/Public/MassCommonFragments.h"
 #include "MassMovement/Public/MassMovementFragments.h"
 #include "Common/Fragments/MSFragments.h"
+#include "ProjectileSim/Fragments/MSProjectileFragments.h"
 
 UMSMovementProcessor::UMSMovementProcessor()
 {
@@ -24,6 +25,9 @@ void UMSMovementProcessor::ConfigureQueries()
 	//ALL must have an FMoverTag
 	MovementEntityQuery.AddTagRequirement<FSampleMoverTag>(EMassFragmentPresence::All);
 
+	//Projectiles are moved by UMSProjectileBallisticsProcessor instead
+	MovementEntityQuery.AddTagRequirement<FProjectileTag>(EMassFragmentPresence::None);
+
 	//must have an FTransformFragment and we are reading and changing it
 	MovementEntityQuery.AddRequirement<FTransformFragment>(EMassFragmentAccess::ReadWrite);
 	
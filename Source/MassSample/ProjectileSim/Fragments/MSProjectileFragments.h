@@ -2,6 +2,8 @@
 #include "CoreMinimal.h"
 #include "MassEntityTypes.h"
 #include "GameplayEffect.h"
+#include "WorldCollision.h"
+#include "GameFramework/Actor.h"
 #include  "MSProjectileFragments.generated.h"
  
 /**
@@ -14,14 +16,43 @@ struct MASSSAMPLE_API FDamageFragment : public FMassFragment
 	float Damage;
 };
 
-// FIXME: Performance investigate making part of this shared? it's going to be very common besides the ignored actors etc?
+// Only what differs per projectile, the rest of the query lives in FSharedProjectileTraceParamsFragment
 USTRUCT(BlueprintType)
 struct MASSSAMPLE_API FLineTraceFragment : public FMassFragment
 {
 	GENERATED_BODY()
-	FCollisionQueryParams QueryParams = FCollisionQueryParams();
 
-	
+	// Where the projectile was before this tick's move, so the trace covers exactly the distance moved
+	FVector TraceStart = FVector::ZeroVector;
+
+	// Actor unique ids, usually just whoever fired the projectile
+	TArray<uint32, TInlineAllocator<2>> IgnoredActorIds;
+
+	void AddIgnoredActors(const TArray<AActor*>& Actors)
+	{
+		for (const AActor* Actor : Actors)
+		{
+			if (Actor) IgnoredActorIds.AddUnique(Actor->GetUniqueID());
+		}
+	}
+
+	// Params are reused across a chunk, so the previous entity's ignores have to go first
+	void ApplyTo(FCollisionQueryParams& QueryParams) const
+	{
+		QueryParams.ClearIgnoredActors();
+		for (const uint32 ActorId : IgnoredActorIds)
+		{
+			QueryParams.AddIgnoredActor(ActorId);
+		}
+	}
+};
+
+// Trace submitted to the world's async trace batch, the resolve processor picks up its result next frame
+USTRUCT()
+struct MASSSAMPLE_API FAsyncLineTraceFragment : public FMassFragment
+{
+	GENERATED_BODY()
+	FTraceHandle TraceHandle;
 };
 
 USTRUCT()
@@ -71,6 +102,57 @@ struct MASSSAMPLE_API FSharedNiagaraSystemFragment : public FMassSharedFragment
 
 };
 
+// Trace settings every projectile of a type shares, keyed by the struct's CRC32
+USTRUCT()
+struct MASSSAMPLE_API FSharedProjectileTraceParamsFragment : public FMassSharedFragment
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere)
+	TEnumAsByte<ECollisionChannel> TraceChannel = ECC_Camera;
+
+	UPROPERTY(EditAnywhere)
+	bool bTraceComplex = false;
+
+	UPROPERTY(EditAnywhere)
+	FName TraceTag;
+
+	FCollisionQueryParams MakeQueryParams() const
+	{
+		return FCollisionQueryParams(TraceTag, bTraceComplex);
+	}
+};
+
+// Ballistics every projectile of a type shares, keyed by the struct's CRC32
+USTRUCT()
+struct MASSSAMPLE_API FSharedProjectileBallisticsFragment : public FMassSharedFragment
+{
+	GENERATED_BODY()
+
+	// Multiplier on the world's gravity
+	UPROPERTY(EditAnywhere)
+	float GravityScale = 1.0f;
+
+	// Quadratic drag per cm travelled, 0 flies in a perfect parabola
+	UPROPERTY(EditAnywhere, meta = (ClampMin = 0))
+	float DragCoefficient = 0.0f;
+
+	// Integration steps per tick for drag only, without drag the parabola is solved exactly and this is ignored.
+	// Hits are still traced as one straight segment per tick: only gravity bends the path, so the segment strays at
+	// most GravityZ * GravityScale * dt^2 / 8 from it, around 0.14 cm at 30 fps, which substeps wouldn't improve on
+	UPROPERTY(EditAnywhere, meta = (ClampMin = 1, ClampMax = 16))
+	int32 NumSubsteps = 1;
+};
+
+// Which pool a projectile returns to after a hit, one per config owning the sim trait
+USTRUCT()
+struct MASSSAMPLE_API FSharedProjectilePoolFragment : public FMassSharedFragment
+{
+	GENERATED_BODY()
+
+	uint32 PoolId = 0;
+};
+
 /**
 * Tags	
 **/
@@ -91,3 +173,31 @@ struct MASSSAMPLE_API FFireHitEventTag : public FMassTag
 {
 	GENERATED_BODY()
 };
+
+// Projectiles traced through the async processors instead of UMSProjectileSimProcessors
+USTRUCT()
+struct MASSSAMPLE_API FAsyncLineTraceTag : public FMassTag
+{
+	GENERATED_BODY()
+};
+
+// Projectiles UMSProjectileSimProcessors traces on worker threads
+USTRUCT()
+struct MASSSAMPLE_API FParallelLineTraceTag : public FMassTag
+{
+	GENERATED_BODY()
+};
+
+// Projectiles that go back to their pool on a hit instead of stopping where they landed
+USTRUCT()
+struct MASSSAMPLE_API FPooledProjectileTag : public FMassTag
+{
+	GENERATED_BODY()
+};
+
+// Parked in the pool, every projectile processor skips these until they get fired again
+USTRUCT()
+struct MASSSAMPLE_API FDormantProjectileTag : public FMassTag
+{
+	GENERATED_BODY()
+};
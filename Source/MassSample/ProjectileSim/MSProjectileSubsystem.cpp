@@ -3,6 +3,7 @@
 #include "MSNiagaraActor.h"
 #include "ProjectileSim/Fragments/MSProjectileFragments.h"
 #include "NiagaraComponent.h"
+#include "StructUtilsTypes.h"
 
 
 void UMSProjectileSubsystem::Initialize(FSubsystemCollectionBase& Collection)
@@ -46,3 +47,89 @@ FSharedStruct UMSProjectileSubsystem::GetOrCreateSharedNiagaraFragmentForSystemT
 	
 }
 
+FSharedStruct UMSProjectileSubsystem::GetOrCreateSharedTraceParamsFragment(const FSharedProjectileTraceParamsFragment& TraceParams)
+{
+	// Unlike the niagara fragment, the whole struct is the key here
+	const uint32 ParamsHash = UE::StructUtils::GetStructCrc32(FConstStructView::Make(TraceParams));
+
+	return MassSubsystem->GetOrCreateSharedFragment<FSharedProjectileTraceParamsFragment>(ParamsHash, TraceParams);
+}
+
+FSharedStruct UMSProjectileSubsystem::GetOrCreateSharedBallisticsFragment(const FSharedProjectileBallisticsFragment& Ballistics)
+{
+	const uint32 ParamsHash = UE::StructUtils::GetStructCrc32(FConstStructView::Make(Ballistics));
+
+	return MassSubsystem->GetOrCreateSharedFragment<FSharedProjectileBallisticsFragment>(ParamsHash, Ballistics);
+}
+
+FSharedStruct UMSProjectileSubsystem::GetOrCreateSharedPoolFragment(const UObject* PoolOwner)
+{
+	FSharedProjectilePoolFragment PoolFragment;
+	PoolFragment.PoolId = PointerHash(PoolOwner);
+
+	return MassSubsystem->GetOrCreateSharedFragment<FSharedProjectilePoolFragment>(PoolFragment.PoolId, PoolFragment);
+}
+
+void UMSProjectileSubsystem::ReturnProjectileToPool(const uint32 PoolId, const FMassEntityHandle Entity)
+{
+	ProjectilePools.FindOrAdd(PoolId).Add(Entity);
+}
+
+FMassEntityHandle UMSProjectileSubsystem::TryReusePooledProjectile(const FMassEntityTemplate& Template)
+{
+	const FSharedStruct* PoolStruct = Template.GetSharedFragmentValues().GetSharedFragments().FindByPredicate(
+		[](const FSharedStruct& SharedStruct)
+		{
+			return SharedStruct.GetScriptStruct() == FSharedProjectilePoolFragment::StaticStruct();
+		});
+	if (!PoolStruct) return FMassEntityHandle();
+
+	TArray<FMassEntityHandle>* Pool = ProjectilePools.Find(PoolStruct->Get<FSharedProjectilePoolFragment>().PoolId);
+	if (!Pool) return FMassEntityHandle();
+
+	const FMassArchetypeCompositionDescriptor& TemplateComposition = Template.GetCompositionDescriptor();
+
+	for (int32 i = Pool->Num() - 1; i >= 0; --i)
+	{
+		const FMassEntityHandle Entity = (*Pool)[i];
+		if (!MassSubsystem->IsEntityValid(Entity))
+		{
+			Pool->RemoveAtSwap(i, 1, false);
+			continue;
+		}
+
+		// Parking is deferred, and a config can share its trait with a child config that adds fragments or tags, or get
+		// spawned with the debug tag
+		const FMassArchetypeCompositionDescriptor& Composition = MassSubsystem->GetArchetypeComposition(MassSubsystem->GetArchetypeForEntity(Entity));
+		if (!Composition.Tags.Contains<FDormantProjectileTag>() || !(Composition.Fragments == TemplateComposition.Fragments)) continue;
+
+		FMassTagBitSet AwakeTags = Composition.Tags;
+		AwakeTags.Remove<FDormantProjectileTag>();
+		if (!(AwakeTags == TemplateComposition.Tags)) continue;
+
+		Pool->RemoveAtSwap(i, 1, false);
+
+		// Same archetype it was spawned in, so no new entity and no new chunk
+		MassSubsystem->RemoveTagFromEntity(Entity, FDormantProjectileTag::StaticStruct());
+
+		// Defaults for everything, then whatever the template overrides, same as a fresh spawn
+		TArray<const UScriptStruct*> FragmentTypes;
+		TemplateComposition.Fragments.ExportTypes(FragmentTypes);
+		TArray<FInstancedStruct> FragmentValues(FragmentTypes);
+		for (const FInstancedStruct& InitialValue : Template.GetInitialFragmentValues())
+		{
+			if (FInstancedStruct* Value = FragmentValues.FindByPredicate([&InitialValue](const FInstancedStruct& Fragment)
+			{
+				return Fragment.GetScriptStruct() == InitialValue.GetScriptStruct();
+			}))
+			{
+				*Value = InitialValue;
+			}
+		}
+		MassSubsystem->SetEntityFragmentsValues(Entity, FragmentValues);
+
+		return Entity;
+	}
+
+	return FMassEntityHandle();
+}
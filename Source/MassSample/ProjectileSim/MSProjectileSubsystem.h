@@ -3,6 +3,7 @@
 
 #include "CoreMinimal.h"
 #include "MassEntitySubsystem.h"
+#include "MassEntityTemplate.h"
 #include "MassRepresentationProcessor.h"
 #include "MSNiagaraActor.h"
 #include "EntitySystem/MovieSceneEntityIDs.h"
@@ -28,6 +29,21 @@ public:
 
 
 
+/** Game thread time the projectile trace processors spent per path, recorded on "projectiles.TraceTimings" */
+struct FMSProjectileTraceTimings
+{
+	bool bRecording = false;
+	int32 Frames = 0;
+
+	double SyncSeconds = 0.0;
+	int64 SyncTraces = 0;
+	double ParallelSeconds = 0.0;
+	int64 ParallelTraces = 0;
+	double AsyncSubmitSeconds = 0.0;
+	double AsyncResolveSeconds = 0.0;
+	int64 AsyncTraces = 0;
+};
+
 //TODO: Might get around using this to store niagara fragments in the future
 //It's still useful to serve as a place anything can get projectile info though...
 UCLASS()
@@ -50,6 +66,25 @@ protected:
 public:
 	FSharedStruct GetOrCreateSharedNiagaraFragmentForSystemType(UNiagaraSystem* NiagaraSystem);
 
+	// Projectile types with identical trace settings end up sharing one fragment
+	FSharedStruct GetOrCreateSharedTraceParamsFragment(const struct FSharedProjectileTraceParamsFragment& TraceParams);
+
+	FSharedStruct GetOrCreateSharedBallisticsFragment(const struct FSharedProjectileBallisticsFragment& Ballistics);
+
+	FSharedStruct GetOrCreateSharedPoolFragment(const UObject* PoolOwner);
+
+	// Parks a pooled projectile once its dormant tag is in, so the next fire of that type can take it back
+	void ReturnProjectileToPool(uint32 PoolId, FMassEntityHandle Entity);
+
+	/** Wakes a dormant projectile spawned from the same template and resets it to the template's values.
+	 *  Returns an invalid handle when the pool is empty or the template doesn't pool. Not safe during processing. */
+	FMassEntityHandle TryReusePooledProjectile(const FMassEntityTemplate& Template);
+
+	// Dormant projectiles per pool id, handed back out newest first
+	TMap<uint32, TArray<FMassEntityHandle>> ProjectilePools;
+
+	FMSProjectileTraceTimings TraceTimings;
+
 	
 	/*This map lets us key based of of the hash of the NiagaraSystem pointer in new projectiles to see if they have an
 	  existing manager actor*/
@@ -19,6 +19,8 @@ void UMSNiagaraRepresentationProcessors::ConfigureQueries()
 {
 	PositionToNiagaraFragmentQuery.AddRequirement<FTransformFragment>(EMassFragmentAccess::ReadOnly);
 	PositionToNiagaraFragmentQuery.AddSharedRequirement<FSharedNiagaraSystemFragment>(EMassFragmentAccess::ReadWrite);
+	//Pooled projectiles waiting to be fired again shouldn't be drawn
+	PositionToNiagaraFragmentQuery.AddTagRequirement<FDormantProjectileTag>(EMassFragmentPresence::None);
 }
 
 
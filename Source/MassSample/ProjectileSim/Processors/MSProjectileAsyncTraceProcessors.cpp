@@ -0,0 +1,124 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MSProjectileAsyncTraceProcessors.h"
+
+#include "MassCommonFragments.h"
+#include "MassMovementFragments.h"
+#include "Misc/ScopeExit.h"
+#include "ProjectileSim/MSProjectileSubsystem.h"
+#include "ProjectileSim/Fragments/MSProjectileFragments.h"
+
+
+UMSProjectileAsyncTraceResolveProcessor::UMSProjectileAsyncTraceResolveProcessor()
+{
+	ExecutionOrder.ExecuteAfter.Add(UE::Mass::ProcessorGroupNames::Movement);
+}
+
+void UMSProjectileAsyncTraceResolveProcessor::Initialize(UObject& Owner)
+{
+	ProjectileSubsystem = GetWorld()->GetSubsystem<UMSProjectileSubsystem>();
+}
+
+void UMSProjectileAsyncTraceResolveProcessor::ConfigureQueries()
+{
+	// Projectiles that already hit lose their FLineTraceFragment, so they drop out of here
+	ResolveQuery.AddRequirement<FAsyncLineTraceFragment>(EMassFragmentAccess::ReadWrite);
+	ResolveQuery.AddRequirement<FLineTraceFragment>(EMassFragmentAccess::ReadOnly);
+	ResolveQuery.AddTagRequirement<FProjectileTag>(EMassFragmentPresence::All);
+	ResolveQuery.AddTagRequirement<FAsyncLineTraceTag>(EMassFragmentPresence::All);
+	ResolveQuery.AddTagRequirement<FDormantProjectileTag>(EMassFragmentPresence::None);
+}
+
+void UMSProjectileAsyncTraceResolveProcessor::Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context)
+{
+	UWorld* World = GetWorld();
+	FMSProjectileTraceTimings& Timings = ProjectileSubsystem->TraceTimings;
+	const double StartTime = FPlatformTime::Seconds();
+	ON_SCOPE_EXIT { Timings.AsyncResolveSeconds += Timings.bRecording ? FPlatformTime::Seconds() - StartTime : 0.0; };
+
+	ResolveQuery.ForEachEntityChunk(EntitySubsystem, Context, [World](FMassExecutionContext& Context)
+	{
+		QUICK_SCOPE_CYCLE_COUNTER(STAT_MASS_AsyncLineTraceResolve);
+
+		const auto AsyncTraces = Context.GetMutableFragmentView<FAsyncLineTraceFragment>();
+		const int32 NumEntities = Context.GetNumEntities();
+
+		for (int32 i = 0; i < NumEntities; ++i)
+		{
+			FTraceHandle& TraceHandle = AsyncTraces[i].TraceHandle;
+
+			// The world only keeps last frame's results around, anything older is gone
+			FTraceDatum TraceDatum;
+			if (!TraceHandle.IsValid() || !World->QueryTraceData(TraceHandle, TraceDatum)) continue;
+			TraceHandle = FTraceHandle();
+
+			if (TraceDatum.OutHits.Num() > 0 && TraceDatum.OutHits[0].bBlockingHit)
+			{
+				FConstStructView HitResultConstStruct = FConstStructView::Make(FHitResultFragment(TraceDatum.OutHits[0]));
+				Context.Defer().PushCommand(FCommandAddFragmentInstance(Context.GetEntity(i), HitResultConstStruct));
+			}
+		}
+	});
+}
+
+
+UMSProjectileAsyncTraceSubmitProcessor::UMSProjectileAsyncTraceSubmitProcessor()
+{
+	ExecutionOrder.ExecuteAfter.Add(UE::Mass::ProcessorGroupNames::Movement);
+	// Last frame's handles have to be read before they get replaced
+	ExecutionOrder.ExecuteAfter.Add(UMSProjectileAsyncTraceResolveProcessor::StaticClass()->GetFName());
+}
+
+void UMSProjectileAsyncTraceSubmitProcessor::Initialize(UObject& Owner)
+{
+	ProjectileSubsystem = GetWorld()->GetSubsystem<UMSProjectileSubsystem>();
+}
+
+void UMSProjectileAsyncTraceSubmitProcessor::ConfigureQueries()
+{
+	SubmitQuery.AddRequirement<FAsyncLineTraceFragment>(EMassFragmentAccess::ReadWrite);
+	SubmitQuery.AddRequirement<FLineTraceFragment>(EMassFragmentAccess::ReadOnly);
+	SubmitQuery.AddRequirement<FTransformFragment>(EMassFragmentAccess::ReadOnly);
+	SubmitQuery.AddSharedRequirement<FSharedProjectileTraceParamsFragment>(EMassFragmentAccess::ReadOnly);
+	SubmitQuery.AddTagRequirement<FProjectileTag>(EMassFragmentPresence::All);
+	SubmitQuery.AddTagRequirement<FAsyncLineTraceTag>(EMassFragmentPresence::All);
+	SubmitQuery.AddTagRequirement<FDormantProjectileTag>(EMassFragmentPresence::None);
+}
+
+void UMSProjectileAsyncTraceSubmitProcessor::Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context)
+{
+	UWorld* World = GetWorld();
+	FMSProjectileTraceTimings& Timings = ProjectileSubsystem->TraceTimings;
+	if (Timings.bRecording) Timings.AsyncTraces += SubmitQuery.GetNumMatchingEntities(EntitySubsystem);
+	const double StartTime = FPlatformTime::Seconds();
+	ON_SCOPE_EXIT { Timings.AsyncSubmitSeconds += Timings.bRecording ? FPlatformTime::Seconds() - StartTime : 0.0; };
+
+	SubmitQuery.ForEachEntityChunk(EntitySubsystem, Context, [World](FMassExecutionContext& Context)
+	{
+		QUICK_SCOPE_CYCLE_COUNTER(STAT_MASS_AsyncLineTraceSubmit);
+
+		const auto AsyncTraces = Context.GetMutableFragmentView<FAsyncLineTraceFragment>();
+		const auto Linetraces = Context.GetFragmentView<FLineTraceFragment>();
+		const auto Transforms = Context.GetFragmentView<FTransformFragment>();
+		const auto& TraceParams = Context.GetSharedFragment<FSharedProjectileTraceParamsFragment>();
+		const int32 NumEntities = Context.GetNumEntities();
+
+		FCollisionQueryParams QueryParams = TraceParams.MakeQueryParams();
+
+		for (int32 i = 0; i < NumEntities; ++i)
+		{
+			const FVector CurrentLocation = Transforms[i].GetTransform().GetTranslation();
+			Linetraces[i].ApplyTo(QueryParams);
+
+			// Only queued here, the world kicks off the whole frame's batch at once at the end of the tick
+			AsyncTraces[i].TraceHandle = World->AsyncLineTraceByChannel(
+				EAsyncTraceType::Single,
+				Linetraces[i].TraceStart,
+				CurrentLocation,
+				TraceParams.TraceChannel,
+				QueryParams
+			);
+		}
+	});
+}
@@ -0,0 +1,49 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MassProcessor.h"
+#include "MSProjectileAsyncTraceProcessors.generated.h"
+
+/**
+ * Picks up the async traces submitted last frame and adds FHitResultFragment to the projectiles that hit something
+ */
+UCLASS()
+class MASSSAMPLE_API UMSProjectileAsyncTraceResolveProcessor : public UMassProcessor
+{
+	GENERATED_BODY()
+
+	UMSProjectileAsyncTraceResolveProcessor();
+
+	virtual void Initialize(UObject& Owner) override;
+	virtual void ConfigureQueries() override;
+
+	virtual void Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context) override;
+
+	FMassEntityQuery ResolveQuery;
+
+	UPROPERTY()
+	class UMSProjectileSubsystem* ProjectileSubsystem;
+};
+
+/**
+ * Submits this frame's projectile traces to the world's async trace batch, which runs them off the game thread
+ */
+UCLASS()
+class MASSSAMPLE_API UMSProjectileAsyncTraceSubmitProcessor : public UMassProcessor
+{
+	GENERATED_BODY()
+
+	UMSProjectileAsyncTraceSubmitProcessor();
+
+	virtual void Initialize(UObject& Owner) override;
+	virtual void ConfigureQueries() override;
+
+	virtual void Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context) override;
+
+	FMassEntityQuery SubmitQuery;
+
+	UPROPERTY()
+	class UMSProjectileSubsystem* ProjectileSubsystem;
+};
@@ -0,0 +1,98 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MSProjectileBallisticsProcessor.h"
+
+#include "MassCommonFragments.h"
+#include "MassMovementFragments.h"
+#include "ProjectileSim/Fragments/MSProjectileFragments.h"
+
+
+UMSProjectileBallisticsProcessor::UMSProjectileBallisticsProcessor()
+{
+	ExecutionFlags = (int32)(EProcessorExecutionFlags::All);
+	ExecutionOrder.ExecuteInGroup = UE::Mass::ProcessorGroupNames::Movement;
+}
+
+void UMSProjectileBallisticsProcessor::ConfigureQueries()
+{
+	// Projectiles that hit something lose these, so they stop right where the hit observer put them
+	BallisticsQuery.AddRequirement<FTransformFragment>(EMassFragmentAccess::ReadWrite);
+	BallisticsQuery.AddRequirement<FMassVelocityFragment>(EMassFragmentAccess::ReadWrite);
+	BallisticsQuery.AddRequirement<FLineTraceFragment>(EMassFragmentAccess::ReadWrite);
+	// Blueprints fire projectiles with SetEntityForce, so a pending force is taken as the launch velocity
+	BallisticsQuery.AddRequirement<FMassForceFragment>(EMassFragmentAccess::ReadWrite, EMassFragmentPresence::Optional);
+	BallisticsQuery.AddSharedRequirement<FSharedProjectileBallisticsFragment>(EMassFragmentAccess::ReadOnly);
+	BallisticsQuery.AddTagRequirement<FProjectileTag>(EMassFragmentPresence::All);
+	BallisticsQuery.AddTagRequirement<FDormantProjectileTag>(EMassFragmentPresence::None);
+}
+
+void UMSProjectileBallisticsProcessor::Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context)
+{
+	const float GravityZ = GetWorld()->GetGravityZ();
+
+	// Nothing is shared between entities, chunks can go wide
+	BallisticsQuery.ParallelForEachEntityChunk(EntitySubsystem, Context, [GravityZ](FMassExecutionContext& Context)
+	{
+		QUICK_SCOPE_CYCLE_COUNTER(STAT_MASS_ProjectileBallistics);
+
+		const auto Transforms = Context.GetMutableFragmentView<FTransformFragment>();
+		const auto Velocities = Context.GetMutableFragmentView<FMassVelocityFragment>();
+		const auto Linetraces = Context.GetMutableFragmentView<FLineTraceFragment>();
+		const auto Forces = Context.GetMutableFragmentView<FMassForceFragment>();
+		const auto& Ballistics = Context.GetSharedFragment<FSharedProjectileBallisticsFragment>();
+		const int32 NumEntities = Context.GetNumEntities();
+
+		// Everything that doesn't depend on the entity is hoisted out of the loops below
+		const float DeltaTime = Context.GetDeltaTimeSeconds();
+		const int32 NumSubsteps = FMath::Max(Ballistics.NumSubsteps, 1);
+		const FVector::FReal StepTime = DeltaTime / NumSubsteps;
+		const FVector Gravity = FVector(0, 0, GravityZ * Ballistics.GravityScale);
+		const FVector GravityStep = Gravity * StepTime;
+		const FVector GravityOffset = 0.5 * GravityStep * StepTime;
+		const FVector::FReal Drag = Ballistics.DragCoefficient;
+
+		if (Forces.Num() > 0)
+		{
+			for (int32 i = 0; i < NumEntities; ++i)
+			{
+				Velocities[i].Value += Forces[i].Value;
+				Forces[i].Value = FVector::ZeroVector;
+			}
+		}
+
+		for (int32 i = 0; i < NumEntities; ++i)
+		{
+			FTransform& Transform = Transforms[i].GetMutableTransform();
+			FVector Location = Transform.GetTranslation();
+			FVector Velocity = Velocities[i].Value;
+
+			Linetraces[i].TraceStart = Location;
+
+			if (Drag > 0)
+			{
+				// Gravity and drag split per substep, each one solved exactly: quadratic drag along a straight
+				// line decays speed by 1 / (1 + k * v * t) and covers ln(1 + k * v * t) / k. Substeps only make the
+				// drag more accurate, the hit trace still runs from TraceStart to the final location
+				for (int32 Step = 0; Step < NumSubsteps; ++Step)
+				{
+					const FVector::FReal DragFactor = Drag * Velocity.Size() * StepTime;
+					const FVector::FReal Decay = 1.0 / (1.0 + DragFactor);
+					const FVector::FReal Travel = DragFactor > KINDA_SMALL_NUMBER ? FMath::Loge(1.0 + DragFactor) / DragFactor : 1.0;
+
+					Location += Velocity * (Travel * StepTime) + GravityOffset;
+					Velocity = Velocity * Decay + GravityStep;
+				}
+			}
+			else
+			{
+				// Plain parabola, exact for any delta time so substeps would change nothing
+				Location += Velocity * DeltaTime + 0.5 * Gravity * DeltaTime * DeltaTime;
+				Velocity += Gravity * DeltaTime;
+			}
+
+			Transform.SetTranslation(Location);
+			Velocities[i].Value = Velocity;
+		}
+	});
+}
@@ -0,0 +1,25 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MassProcessor.h"
+#include "MSProjectileBallisticsProcessor.generated.h"
+
+/**
+ * Moves projectiles under gravity and drag with a closed form step, UMSProjectileLifeTimeProcessor ages their lifetime.
+ * Records where each one started the tick so the trace processors sweep exactly the distance moved.
+ */
+UCLASS()
+class MASSSAMPLE_API UMSProjectileBallisticsProcessor : public UMassProcessor
+{
+	GENERATED_BODY()
+
+	UMSProjectileBallisticsProcessor();
+
+	virtual void ConfigureQueries() override;
+
+	virtual void Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context) override;
+
+	FMassEntityQuery BallisticsQuery;
+};
@@ -6,6 +6,7 @@
 #include "MassCommonFragments.h"
 #include "MassMovementFragments.h"
 #include "ProjectileSim/MassProjectileHitInterface.h"
+#include "ProjectileSim/MSProjectileSubsystem.h"
 #include "ProjectileSim/Fragments/MSProjectileFragments.h"
 
 UMSProjectileHitObserver::UMSProjectileHitObserver()
@@ -22,6 +23,11 @@ void UMSProjectileHitObserver::ConfigureQueries()
 	StopHitsQuery.AddRequirement<FTransformFragment>(EMassFragmentAccess::ReadWrite);
 	StopHitsQuery.AddRequirement<FLineTraceFragment>(EMassFragmentAccess::ReadOnly);
 	StopHitsQuery.AddRequirement<FHitResultFragment>(EMassFragmentAccess::ReadOnly);
+	StopHitsQuery.AddTagRequirement<FPooledProjectileTag>(EMassFragmentPresence::None);
+
+	PoolHitsQuery.AddRequirement<FHitResultFragment>(EMassFragmentAccess::ReadOnly);
+	PoolHitsQuery.AddSharedRequirement<FSharedProjectilePoolFragment>(EMassFragmentAccess::ReadOnly);
+	PoolHitsQuery.AddTagRequirement<FPooledProjectileTag>(EMassFragmentPresence::All);
 
 	//You can always add another query for different in the same observer processor!
 	CollisionHitEventQuery.AddTagRequirement<FFireHitEventTag>(EMassFragmentPresence::All);
@@ -55,6 +61,21 @@ void UMSProjectileHitObserver::Execute(UMassEntitySubsystem& EntitySubsystem, FM
 				}
 
 			});
+
+			// Keeps its fragments so it goes back into the archetype it was spawned in once woken up
+			UMSProjectileSubsystem* ProjectileSubsystem = GetWorld()->GetSubsystem<UMSProjectileSubsystem>();
+			PoolHitsQuery.ForEachEntityChunk(EntitySubsystem, Context, [ProjectileSubsystem](FMassExecutionContext& Context)
+			{
+				const uint32 PoolId = Context.GetSharedFragment<FSharedProjectilePoolFragment>().PoolId;
+
+				for (int32 EntityIndex = 0; EntityIndex < Context.GetNumEntities(); ++EntityIndex)
+				{
+					const FMassEntityHandle Entity = Context.GetEntity(EntityIndex);
+					Context.Defer().RemoveFragment<FHitResultFragment>(Entity);
+					Context.Defer().AddTag<FDormantProjectileTag>(Entity);
+					ProjectileSubsystem->ReturnProjectileToPool(PoolId, Entity);
+				}
+			});
 	
 			CollisionHitEventQuery.ForEachEntityChunk(EntitySubsystem, Context, [&,this](FMassExecutionContext& Context)
 			{
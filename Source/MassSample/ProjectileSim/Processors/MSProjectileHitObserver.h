@@ -25,6 +25,8 @@ protected:
 
 	FMassEntityQuery StopHitsQuery;
 
+	FMassEntityQuery PoolHitsQuery;
+
 	FMassEntityQuery CollisionHitEventQuery;
 
 };
@@ -0,0 +1,50 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MSProjectileLifeTimeProcessor.h"
+
+#include "ProjectileSim/Fragments/MSProjectileFragments.h"
+
+
+UMSProjectileLifeTimeProcessor::UMSProjectileLifeTimeProcessor()
+{
+	ExecutionFlags = (int32)(EProcessorExecutionFlags::All);
+	ExecutionOrder.ExecuteAfter.Add(UE::Mass::ProcessorGroupNames::Movement);
+}
+
+void UMSProjectileLifeTimeProcessor::ConfigureQueries()
+{
+	// Stopped projectiles still count down and expire, dormant ones are waiting in their pool
+	LifeTimeQuery.AddRequirement<FLifeTimeFragment>(EMassFragmentAccess::ReadWrite);
+	LifeTimeQuery.AddTagRequirement<FProjectileTag>(EMassFragmentPresence::All);
+	LifeTimeQuery.AddTagRequirement<FDormantProjectileTag>(EMassFragmentPresence::None);
+}
+
+void UMSProjectileLifeTimeProcessor::Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context)
+{
+	LifeTimeQuery.ForEachEntityChunk(EntitySubsystem, Context, [](FMassExecutionContext& Context)
+	{
+		QUICK_SCOPE_CYCLE_COUNTER(STAT_MASS_ProjectileLifeTime);
+
+		const auto LifeTimes = Context.GetMutableFragmentView<FLifeTimeFragment>();
+		const int32 NumEntities = Context.GetNumEntities();
+		const float DeltaTime = Context.GetDeltaTimeSeconds();
+
+		TArray<FMassEntityHandle, TInlineAllocator<64>> ExpiredEntities;
+
+		for (int32 i = 0; i < NumEntities; ++i)
+		{
+			LifeTimes[i].Time -= DeltaTime;
+			if (LifeTimes[i].Time <= 0.0f)
+			{
+				ExpiredEntities.Add(Context.GetEntity(i));
+			}
+		}
+
+		// A whole chunk of projectiles fired together tends to expire together
+		if (ExpiredEntities.Num() > 0)
+		{
+			Context.Defer().DestroyEntities(ExpiredEntities);
+		}
+	});
+}
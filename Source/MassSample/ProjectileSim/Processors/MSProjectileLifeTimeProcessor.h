@@ -0,0 +1,24 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MassProcessor.h"
+#include "MSProjectileLifeTimeProcessor.generated.h"
+
+/**
+ * Counts every projectile's FLifeTimeFragment down and destroys the ones that ran out, one deferred batch per chunk
+ */
+UCLASS()
+class MASSSAMPLE_API UMSProjectileLifeTimeProcessor : public UMassProcessor
+{
+	GENERATED_BODY()
+
+	UMSProjectileLifeTimeProcessor();
+
+	virtual void ConfigureQueries() override;
+
+	virtual void Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context) override;
+
+	FMassEntityQuery LifeTimeQuery;
+};
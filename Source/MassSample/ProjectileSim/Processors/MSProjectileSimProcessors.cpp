@@ -8,12 +8,15 @@
 #include "ProjectileSim/Fragments/MSProjectileFragments.h"
 #include "MassRepresentationTypes.h"
 #include "Common/Fragments/MSFragments.h"
+#include "Common/Misc/MSDeferredCommands.h"
+#include "Misc/ScopeLock.h"
 #include "HAL/ThreadManager.h"
+#include "ProjectileSim/MSProjectileSubsystem.h"
 
 
 void UMSProjectileSimProcessors::Initialize(UObject& Owner)
 {
-	
+	ProjectileSubsystem = GetWorld()->GetSubsystem<UMSProjectileSubsystem>();
 }
 
 
@@ -25,48 +28,66 @@ UMSProjectileSimProcessors::UMSProjectileSimProcessors()
 void UMSProjectileSimProcessors::ConfigureQueries()
 {
 	LineTraceFromPreviousPosition.AddRequirement<FLineTraceFragment>(EMassFragmentAccess::ReadWrite);
-	LineTraceFromPreviousPosition.AddRequirement<FMassVelocityFragment>(EMassFragmentAccess::ReadOnly);
 	LineTraceFromPreviousPosition.AddRequirement<FTransformFragment>(EMassFragmentAccess::ReadOnly);
+	LineTraceFromPreviousPosition.AddSharedRequirement<FSharedProjectileTraceParamsFragment>(EMassFragmentAccess::ReadOnly);
 	LineTraceFromPreviousPosition.AddTagRequirement<FProjectileTag>(EMassFragmentPresence::All);
+	LineTraceFromPreviousPosition.AddTagRequirement<FDormantProjectileTag>(EMassFragmentPresence::None);
 
 	MyQuery = LineTraceFromPreviousPosition;
 
 	MyQuery.AddRequirement<FSampleColorFragment>(EMassFragmentAccess::ReadOnly,EMassFragmentPresence::Optional);
 
+	ParallelLineTraceFromPreviousPosition = LineTraceFromPreviousPosition;
+	ParallelLineTraceFromPreviousPosition.AddTagRequirement<FParallelLineTraceTag>(EMassFragmentPresence::All);
+
+	// Those go through UMSProjectileAsyncTraceSubmitProcessor
+	LineTraceFromPreviousPosition.AddTagRequirement<FAsyncLineTraceTag>(EMassFragmentPresence::None);
+	LineTraceFromPreviousPosition.AddTagRequirement<FParallelLineTraceTag>(EMassFragmentPresence::None);
+
 	//LineTraceFromPreviousPosition.AddTagRequirement<FNotMovingTag>(EMassFragmentPresence::None);
 }
 
 void UMSProjectileSimProcessors::Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context)
 {
+	FMSProjectileTraceTimings& Timings = ProjectileSubsystem->TraceTimings;
+	if (Timings.bRecording)
+	{
+		Timings.SyncTraces += LineTraceFromPreviousPosition.GetNumMatchingEntities(EntitySubsystem);
+		Timings.ParallelTraces += ParallelLineTraceFromPreviousPosition.GetNumMatchingEntities(EntitySubsystem);
+	}
 
-	
+	double StartTime = FPlatformTime::Seconds();
 	LineTraceFromPreviousPosition.ForEachEntityChunk(EntitySubsystem,Context,[this](FMassExecutionContext& Context)
 	{
 		QUICK_SCOPE_CYCLE_COUNTER(STAT_MASS_LineTraceFromPreviousPosition);
 
 		
-		const auto Linetraces = Context.GetMutableFragmentView<FLineTraceFragment>();
-		const auto Velocities = Context.GetFragmentView<FMassVelocityFragment>();
+		const auto Linetraces = Context.GetFragmentView<FLineTraceFragment>();
 		const auto Transforms = Context.GetFragmentView<FTransformFragment>();
+		const auto& TraceParams = Context.GetSharedFragment<FSharedProjectileTraceParamsFragment>();
 
 		int32 NumEntities= Context.GetNumEntities();
 
+		// Built once per chunk, only the ignored actors change between entities
+		FCollisionQueryParams QueryParams = TraceParams.MakeQueryParams();
+
 
 		for (int32 i = 0; i < NumEntities; ++i)
 		{
 			FHitResult HitResult;
 
 			FVector CurrentLocation = Transforms[i].GetTransform().GetTranslation();
+			Linetraces[i].ApplyTo(QueryParams);
 			
 			//If we hit something, add a new fragment with the data!
 			if(GetWorld()->
 				LineTraceSingleByChannel(
 					HitResult,
 					
-					CurrentLocation - Velocities[i].Value,
+					Linetraces[i].TraceStart,
 					CurrentLocation,
-					ECollisionChannel::ECC_Camera,
-					Linetraces[i].QueryParams
+					TraceParams.TraceChannel,
+					QueryParams
 				))
 			{
 		
@@ -79,10 +100,55 @@ void UMSProjectileSimProcessors::Execute(UMassEntitySubsystem& EntitySubsystem,
 		}
 	});
 
+	Timings.SyncSeconds += Timings.bRecording ? FPlatformTime::Seconds() - StartTime : 0.0;
 
+	// Scene queries only read the physics scene, so the chunks can trace on any thread
+	StartTime = FPlatformTime::Seconds();
+	ParallelLineTraceFromPreviousPosition.ParallelForEachEntityChunk(EntitySubsystem, Context, [this](FMassExecutionContext& Context)
+	{
+		QUICK_SCOPE_CYCLE_COUNTER(STAT_MASS_ParallelLineTraceFromPreviousPosition);
 
+		const auto Linetraces = Context.GetFragmentView<FLineTraceFragment>();
+		const auto Transforms = Context.GetFragmentView<FTransformFragment>();
+		const auto& TraceParams = Context.GetSharedFragment<FSharedProjectileTraceParamsFragment>();
+		const int32 NumEntities = Context.GetNumEntities();
+
+		FCollisionQueryParams QueryParams = TraceParams.MakeQueryParams();
+
+		// Local to the task, the shared lists are only locked once per chunk
+		TArray<FMassEntityHandle, TInlineAllocator<32>> ChunkHitEntities;
+		TArray<FHitResult, TInlineAllocator<32>> ChunkHitResults;
+
+		for (int32 i = 0; i < NumEntities; ++i)
+		{
+			FHitResult HitResult;
+			const FVector CurrentLocation = Transforms[i].GetTransform().GetTranslation();
+			Linetraces[i].ApplyTo(QueryParams);
+
+			if (GetWorld()->LineTraceSingleByChannel(HitResult, Linetraces[i].TraceStart, CurrentLocation,
+			                                         TraceParams.TraceChannel, QueryParams))
+			{
+				ChunkHitEntities.Add(Context.GetEntity(i));
+				ChunkHitResults.Add(HitResult);
+			}
+		}
+
+		if (ChunkHitEntities.Num() > 0)
+		{
+			FScopeLock Lock(&ParallelHitsLock);
+			ParallelHitEntities.Append(ChunkHitEntities);
+			ParallelHitResults.Append(ChunkHitResults);
+		}
+	});
+
+	if (ParallelHitEntities.Num() > 0)
+	{
+		Context.Defer().PushCommand(FBatchAddHitResultFragments(MoveTemp(ParallelHitEntities), MoveTemp(ParallelHitResults)));
+		ParallelHitEntities.Reset();
+		ParallelHitResults.Reset();
+	}
+	Timings.ParallelSeconds += Timings.bRecording ? FPlatformTime::Seconds() - StartTime : 0.0;
 
-		
 	MyQuery.ForEachEntityChunk(EntitySubsystem, Context, [](FMassExecutionContext& Context)
 	{
 		const TArrayView<FSampleColorFragment> OptionalFragmentList = Context.GetMutableFragmentView<FSampleColorFragment>();
@@ -5,6 +5,7 @@
 #include "CoreMinimal.h"
 #include "MassMovementFragments.h"
 #include "MassProcessor.h"
+#include "Engine/HitResult.h"
 #include "MSProjectileSimProcessors.generated.h"
 /**
  * 
@@ -23,7 +24,16 @@ class MASSSAMPLE_API UMSProjectileSimProcessors : public UMassProcessor
 	virtual void Initialize(UObject& Owner) override;
 	
 	FMassEntityQuery LineTraceFromPreviousPosition;
+	FMassEntityQuery ParallelLineTraceFromPreviousPosition;
 	FMassEntityQuery MyQuery;
+
+	UPROPERTY()
+	class UMSProjectileSubsystem* ProjectileSubsystem;
+
+	// Hits of the parallel traces, merged from every chunk into one command
+	TArray<FMassEntityHandle> ParallelHitEntities;
+	TArray<FHitResult> ParallelHitResults;
+	FCriticalSection ParallelHitsLock;
 };
 
 
@@ -0,0 +1,221 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MSProjectileTraceBenchmarkProcessor.h"
+
+#include "MassCommonTypes.h"
+#include "ProjectileSim/MSProjectileSubsystem.h"
+#include "Async/ParallelFor.h"
+#include "GameFramework/PlayerController.h"
+#include "Misc/ScopeLock.h"
+
+namespace MSProjectileTraceBenchmark
+{
+	static constexpr int32 SegmentCounts[] = {1000, 10000, 50000};
+
+	/** Same block size for the parallel pass as a projectile chunk roughly holds */
+	static constexpr int32 BlockSize = 128;
+
+	/** About the distance a fast projectile covers in a frame */
+	static constexpr float SegmentLength = 1000.0f;
+	static constexpr float SpawnExtent = 5000.0f;
+
+	static bool bRequested = false;
+
+	/** Frames asked for by the last "projectiles.TraceTimings", 0 when there is nothing to start */
+	static int32 RequestedTimingFrames = 0;
+}
+
+static FAutoConsoleCommand ProjectileTraceBenchmarkCommand(
+	TEXT("projectiles.TraceBenchmark"),
+	TEXT("Times serial, parallel and async projectile line traces with 1k, 10k and 50k segments over the next frames and logs the results."),
+	FConsoleCommandDelegate::CreateLambda([]() { MSProjectileTraceBenchmark::bRequested = true; })
+);
+
+static FAutoConsoleCommand ProjectileTraceTimingsCommand(
+	TEXT("projectiles.TraceTimings"),
+	TEXT("Times the sync, parallel and async projectile trace processors on the projectiles in flight over the next frames (default 120) and logs the averages."),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		MSProjectileTraceBenchmark::RequestedTimingFrames = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 120;
+	})
+);
+
+UMSProjectileTraceBenchmarkProcessor::UMSProjectileTraceBenchmarkProcessor()
+{
+	ExecutionOrder.ExecuteAfter.Add(UE::Mass::ProcessorGroupNames::Movement);
+}
+
+void UMSProjectileTraceBenchmarkProcessor::Initialize(UObject& Owner)
+{
+	ProjectileSubsystem = GetWorld()->GetSubsystem<UMSProjectileSubsystem>();
+}
+
+void UMSProjectileTraceBenchmarkProcessor::ConfigureQueries()
+{
+	// No entity queries, the segments are made up so every mode traces the exact same ones
+}
+
+void UMSProjectileTraceBenchmarkProcessor::Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context)
+{
+	using namespace MSProjectileTraceBenchmark;
+
+	TickTraceTimings();
+
+	if (bRequested)
+	{
+		bRequested = false;
+		CountIndex = 0;
+		AsyncHandles.Reset();
+	}
+
+	if (CountIndex == INDEX_NONE) return;
+
+	if (AsyncHandles.Num() > 0)
+	{
+		ResolveAsyncPass();
+		if (++CountIndex == UE_ARRAY_COUNT(SegmentCounts)) CountIndex = INDEX_NONE;
+		return;
+	}
+
+	RunTracePasses();
+}
+
+void UMSProjectileTraceBenchmarkProcessor::RunTracePasses()
+{
+	using namespace MSProjectileTraceBenchmark;
+
+	UWorld* World = GetWorld();
+	const int32 NumSegments = SegmentCounts[CountIndex];
+
+	FVector ViewLocation = FVector::ZeroVector;
+	FRotator ViewRotation;
+	if (const APlayerController* PlayerController = World->GetFirstPlayerController())
+	{
+		PlayerController->GetPlayerViewPoint(ViewLocation, ViewRotation);
+	}
+
+	// Seeded, so runs stay comparable between builds
+	FRandomStream RandomStream(NumSegments);
+	SegmentStarts.SetNumUninitialized(NumSegments);
+	SegmentEnds.SetNumUninitialized(NumSegments);
+	for (int32 i = 0; i < NumSegments; ++i)
+	{
+		SegmentStarts[i] = ViewLocation + RandomStream.VRand() * RandomStream.FRandRange(0.0f, SpawnExtent);
+		SegmentEnds[i] = SegmentStarts[i] + RandomStream.VRand() * SegmentLength;
+	}
+
+	const FCollisionQueryParams QueryParams;
+
+	double StartTime = FPlatformTime::Seconds();
+	SerialHits = 0;
+	for (int32 i = 0; i < NumSegments; ++i)
+	{
+		FHitResult HitResult;
+		SerialHits += World->LineTraceSingleByChannel(HitResult, SegmentStarts[i], SegmentEnds[i],
+		                                              ECollisionChannel::ECC_Camera, QueryParams);
+	}
+	SerialMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+
+	// Same shape as the processor: hits gathered per block, merged under a lock once per block
+	TArray<int32> HitIndices;
+	TArray<FHitResult> HitResults;
+	FCriticalSection HitsLock;
+	StartTime = FPlatformTime::Seconds();
+	ParallelFor(FMath::DivideAndRoundUp(NumSegments, BlockSize), [&](const int32 BlockIndex)
+	{
+		const int32 Begin = BlockIndex * BlockSize;
+		const int32 End = FMath::Min(Begin + BlockSize, NumSegments);
+
+		TArray<int32, TInlineAllocator<32>> BlockHitIndices;
+		TArray<FHitResult, TInlineAllocator<32>> BlockHitResults;
+		for (int32 i = Begin; i < End; ++i)
+		{
+			FHitResult HitResult;
+			if (World->LineTraceSingleByChannel(HitResult, SegmentStarts[i], SegmentEnds[i],
+			                                    ECollisionChannel::ECC_Camera, QueryParams))
+			{
+				BlockHitIndices.Add(i);
+				BlockHitResults.Add(HitResult);
+			}
+		}
+
+		if (BlockHitIndices.Num() > 0)
+		{
+			FScopeLock Lock(&HitsLock);
+			HitIndices.Append(BlockHitIndices);
+			HitResults.Append(BlockHitResults);
+		}
+	});
+	ParallelMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+	ParallelHits = HitIndices.Num();
+
+	StartTime = FPlatformTime::Seconds();
+	AsyncHandles.SetNumUninitialized(NumSegments);
+	for (int32 i = 0; i < NumSegments; ++i)
+	{
+		AsyncHandles[i] = World->AsyncLineTraceByChannel(EAsyncTraceType::Single, SegmentStarts[i], SegmentEnds[i],
+		                                                  ECollisionChannel::ECC_Camera, QueryParams);
+	}
+	AsyncSubmitMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+}
+
+void UMSProjectileTraceBenchmarkProcessor::ResolveAsyncPass()
+{
+	using namespace MSProjectileTraceBenchmark;
+
+	UWorld* World = GetWorld();
+
+	int32 AsyncHits = 0;
+	int32 AsyncMissing = 0;
+	const double StartTime = FPlatformTime::Seconds();
+	for (const FTraceHandle& Handle : AsyncHandles)
+	{
+		FTraceDatum TraceDatum;
+		if (!World->QueryTraceData(Handle, TraceDatum))
+		{
+			++AsyncMissing;
+			continue;
+		}
+		AsyncHits += TraceDatum.OutHits.Num() > 0 && TraceDatum.OutHits[0].bBlockingHit;
+	}
+	const double AsyncResolveMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+
+	UE_LOG(LogTemp, Log, TEXT("Projectile traces: %d segments, serial %.3f ms (%d hits), parallel %.3f ms (%d hits), async %.3f ms submit + %.3f ms resolve on the game thread (%d hits, %d results missing)"),
+	       AsyncHandles.Num(), SerialMs, SerialHits, ParallelMs, ParallelHits, AsyncSubmitMs, AsyncResolveMs, AsyncHits,
+	       AsyncMissing);
+
+	AsyncHandles.Reset();
+}
+
+void UMSProjectileTraceBenchmarkProcessor::TickTraceTimings()
+{
+	using namespace MSProjectileTraceBenchmark;
+
+	FMSProjectileTraceTimings& Timings = ProjectileSubsystem->TraceTimings;
+	if (RequestedTimingFrames > 0)
+	{
+		Timings = FMSProjectileTraceTimings();
+		Timings.bRecording = true;
+		TimingFramesLeft = RequestedTimingFrames;
+		RequestedTimingFrames = 0;
+		return;
+	}
+
+	if (!Timings.bRecording) return;
+
+	++Timings.Frames;
+	if (--TimingFramesLeft > 0) return;
+	Timings.bRecording = false;
+
+	const auto MsPerFrame = [&Timings](const double Seconds) { return Seconds * 1000.0 / Timings.Frames; };
+	const auto UsPerTrace = [](const double Seconds, const int64 Traces)
+	{
+		return Traces > 0 ? Seconds * 1000000.0 / Traces : 0.0;
+	};
+	UE_LOG(LogTemp, Log, TEXT("Projectile trace processors over %d frames: sync %.3f ms/frame (%.2f us/trace, %lld traces), parallel %.3f ms/frame (%.2f us/trace, %lld traces), async %.3f ms submit + %.3f ms resolve per frame on the game thread (%lld traces)"),
+	       Timings.Frames,
+	       MsPerFrame(Timings.SyncSeconds), UsPerTrace(Timings.SyncSeconds, Timings.SyncTraces), Timings.SyncTraces,
+	       MsPerFrame(Timings.ParallelSeconds), UsPerTrace(Timings.ParallelSeconds, Timings.ParallelTraces), Timings.ParallelTraces,
+	       MsPerFrame(Timings.AsyncSubmitSeconds), MsPerFrame(Timings.AsyncResolveSeconds), Timings.AsyncTraces);
+}
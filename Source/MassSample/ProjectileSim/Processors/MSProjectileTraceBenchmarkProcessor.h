@@ -0,0 +1,57 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MassProcessor.h"
+#include "WorldCollision.h"
+#include "MSProjectileTraceBenchmarkProcessor.generated.h"
+
+/**
+ * Runs on "projectiles.TraceBenchmark": times the serial, parallel and async projectile trace paths over 1k, 10k and
+ * 50k synthetic segments around the first player's view, two frames per count since async results come a frame later.
+ * These are stand-ins with the same loop shapes as the trace processors, not the processors themselves, so every mode
+ * traces the exact same segments.
+ *
+ * "projectiles.TraceTimings [Frames]" times the real trace processors on the projectiles in flight instead, logging
+ * the average per frame and per trace of each path once the frames are up.
+ */
+UCLASS()
+class MASSSAMPLE_API UMSProjectileTraceBenchmarkProcessor : public UMassProcessor
+{
+	GENERATED_BODY()
+
+	UMSProjectileTraceBenchmarkProcessor();
+
+	virtual void Initialize(UObject& Owner) override;
+	virtual void ConfigureQueries() override;
+	virtual void Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context) override;
+
+	/** Serial and parallel passes plus the async submit for the current count */
+	void RunTracePasses();
+
+	/** Collects last frame's async results and logs the row of the current count */
+	void ResolveAsyncPass();
+
+	/** Counts down the frames of a "projectiles.TraceTimings" run and logs it at the end */
+	void TickTraceTimings();
+
+	/** Frames left in the current "projectiles.TraceTimings" run */
+	int32 TimingFramesLeft = 0;
+
+	UPROPERTY()
+	class UMSProjectileSubsystem* ProjectileSubsystem;
+
+	/** Index in the segment counts of the current run, INDEX_NONE when not running */
+	int32 CountIndex = INDEX_NONE;
+
+	TArray<FVector> SegmentStarts;
+	TArray<FVector> SegmentEnds;
+	TArray<FTraceHandle> AsyncHandles;
+
+	double SerialMs = 0.0;
+	double ParallelMs = 0.0;
+	double AsyncSubmitMs = 0.0;
+	int32 SerialHits = 0;
+	int32 ParallelHits = 0;
+};
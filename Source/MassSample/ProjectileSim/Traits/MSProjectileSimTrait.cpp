@@ -7,21 +7,48 @@
 #include "MassEntityTemplateRegistry.h"
 #include "MassMovementFragments.h"
 #include "ProjectileSim/Fragments/MSProjectileFragments.h"
+#include "ProjectileSim/MSProjectileSubsystem.h"
 #include "NiagaraSystem.h"
 
 void UMSProjectileSimTrait::BuildTemplate(FMassEntityTemplateBuildContext& BuildContext, UWorld& World) const
 {
 	
 	
+	UMSProjectileSubsystem* ProjectileSubsystem = UWorld::GetSubsystem<UMSProjectileSubsystem>(&World);
+
 	BuildContext.AddFragment<FLineTraceFragment>();
+	BuildContext.AddSharedFragment(ProjectileSubsystem->GetOrCreateSharedTraceParamsFragment(TraceParams));
+	BuildContext.AddSharedFragment(ProjectileSubsystem->GetOrCreateSharedBallisticsFragment(Ballistics));
 	BuildContext.AddFragment<FTransformFragment>();
 	BuildContext.AddFragment<FMassVelocityFragment>();
 	BuildContext.AddTag<FProjectileTag>();
 
+	if(LifeTime > 0.0f)
+	{
+		BuildContext.AddFragment_GetRef<FLifeTimeFragment>().Time = LifeTime;
+	}
+
+	if(bPoolOnHit)
+	{
+		// Keyed by the config asset owning this trait, so every projectile of that config shares a pool
+		BuildContext.AddSharedFragment(ProjectileSubsystem->GetOrCreateSharedPoolFragment(GetOuter()));
+		BuildContext.AddTag<FPooledProjectileTag>();
+	}
+
 	if(bFiresHitEventToActors)
 	{
 		BuildContext.AddTag<FFireHitEventTag>();
 	}
 
+	if(TraceMode == EMSProjectileTraceMode::Parallel)
+	{
+		BuildContext.AddTag<FParallelLineTraceTag>();
+	}
+	else if(TraceMode == EMSProjectileTraceMode::Async)
+	{
+		BuildContext.AddFragment<FAsyncLineTraceFragment>();
+		BuildContext.AddTag<FAsyncLineTraceTag>();
+	}
+
 	
 }
@@ -4,12 +4,24 @@
 
 #include "CoreMinimal.h"
 #include "MassEntityTraitBase.h"
+#include "ProjectileSim/Fragments/MSProjectileFragments.h"
 #include "MSProjectileSimTrait.generated.h"
 
 /**
  * 
  */
 
+UENUM()
+enum class EMSProjectileTraceMode : uint8
+{
+	// Traced on the game thread as they move, hits land the same frame
+	Sync,
+	// Traced on worker threads chunk by chunk, hits land the same frame
+	Parallel,
+	// Traces go out with the world's async trace batch, hits land a frame later
+	Async
+};
+
 UCLASS(meta = (DisplayName = "Pojectile Simulation"))
 class MASSSAMPLE_API UMSProjectileSimTrait : public UMassEntityTraitBase
 {
@@ -19,5 +31,23 @@ public:
 
 	UPROPERTY(EditAnywhere)
 	bool bFiresHitEventToActors = true;
+
+	UPROPERTY(EditAnywhere)
+	EMSProjectileTraceMode TraceMode = EMSProjectileTraceMode::Sync;
+
+	// Shared by every projectile with the same settings, ignored actors stay per entity
+	UPROPERTY(EditAnywhere)
+	FSharedProjectileTraceParamsFragment TraceParams;
+
+	UPROPERTY(EditAnywhere)
+	FSharedProjectileBallisticsFragment Ballistics;
+
+	// Seconds before the projectile expires, 0 lives forever
+	UPROPERTY(EditAnywhere, meta = (ClampMin = 0))
+	float LifeTime = 0.0f;
+
+	// Park projectiles that hit something and hand them back out on the next fire instead of leaving them in the world
+	UPROPERTY(EditAnywhere)
+	bool bPoolOnHit = false;
 };
 